@@ -19,6 +19,7 @@
  * 4. Return 1 (good), 0 (bad), or -1 (error)
  */
 
+ #define _GNU_SOURCE
  #include <unistd.h>
  #include <stdio.h>
  #include <stdlib.h>
@@ -27,7 +28,19 @@
  #include <errno.h>
  #include <sys/wait.h>
  #include <sys/types.h>
+ #include <sys/resource.h>
+ #include <sys/mman.h>
+ #include <stdint.h>
+ #include <sys/syscall.h>
+ #include <sys/socket.h>
+ #include <sched.h>
+ #include <link.h>
+ #include <ucontext.h>
+ #include <fcntl.h>
+ #include <sys/epoll.h>
+ #include <sys/timerfd.h>
  #include <string.h>
+ #include <time.h>
  
  // Global variable for child process PID
 static pid_t child_pid;
@@ -107,9 +120,10 @@ void	alarm_handler(int sig)
 	  * - waitpid() can return for various reasons:
 	  *   1. Child terminated normally (exit)
 	  *   2. Child was terminated by signal
-	  *   3. waitpid was interrupted by SIGALRM (timeout)
+	  *   3. Child was stopped by signal (WUNTRACED: SIGSTOP, SIGTSTP...)
+	  *   4. waitpid was interrupted by SIGALRM (timeout)
 	  */
-	 if (waitpid(pid, &status, 0) == -1)
+	 if (waitpid(pid, &status, WUNTRACED) == -1)
 	 {
 		 if (errno == EINTR)  // Interrupted by SIGALRM
 		 {
@@ -133,6 +147,24 @@ void	alarm_handler(int sig)
 	  * ANALYZE HOW THE PROCESS TERMINATED:
 	  */
 	 
+	 if (WIFSTOPPED(status))
+	 {
+		 /*
+		  * STOPPED BY SIGNAL:
+		  * - Without WUNTRACED this would hang until the alarm and be
+		  *   reported as a timeout
+		  * - A stopped process still dies from SIGKILL: kill, collect,
+		  *   and cancel the alarm that is no longer needed
+		  */
+		 int sig = WSTOPSIG(status);
+		 kill(pid, SIGKILL);
+		 waitpid(pid, NULL, 0);  // Collect zombie process
+		 alarm(0);
+		 if (verbose)
+			 printf("Bad function: %s\n", strsignal(sig));
+		 return 0;  // Bad function
+	 }
+	 
 	 if (WIFEXITED(status))
 	 {
 		 /*
@@ -170,6 +202,2603 @@ void	alarm_handler(int sig)
 	 return -1;  // Unrecognized state
  }
  
+ /*
+  * SUPERVISION WITHOUT SIGNALS (pidfd + timerfd + epoll):
+  * - sandbox() above is the exam version: process-wide SIGALRM handler,
+  *   alarm() and EINTR, so one sandbox at a time and no threads
+  * - Here every child is a self-contained sb_proc:
+  *   . pidfd (pidfd_open): readable as soon as the child terminates
+  *   . timerfd (CLOCK_MONOTONIC, absolute): fires at the deadline
+  *   . epfd: an epoll set with both, readable whenever sb_step() has
+  *     something to do; pools just nest these epfds in their own epoll
+  * - No signal disposition, mask or global is touched, so any number of
+  *   sandboxes can run from any number of threads
+  * - STOPS (the WUNTRACED of sandbox()): a pidfd only reports
+  *   termination, and a child stopped by SIGSTOP/SIGTSTP would sit
+  *   there until its deadline (an SB_TIMEOUT, SIGKILL works on stopped
+  *   processes too), or forever without one. So the timerfd also
+  *   carries a polling tick (1 ms, doubling up to 16 ms) and each tick
+  *   asks waitid(WSTOPPED): a stopped child is killed and reaped right
+  *   away, verdict SB_STOPPED. opts->no_stop_poll drops the tick, so a
+  *   running child costs no wakeup at all before its deadline, for
+  *   callers that know f() never stops (or want a stop to time out)
+  * - FALLBACK (kernels < 5.3, no pidfd_open): the same tick, always
+  *   armed then, is what notices that the child has terminated
+  * - WHOLE TREE: the child leads its own process group (setpgid on both
+  *   sides of fork, so there is no window), and whenever it ends, by
+  *   itself or on timeout, the group gets SIGKILL before the child is
+  *   reaped: the zombie pins the group id, so it cannot have been
+  *   reused. Anything f() forked dies with it, unless it left the group
+  *   with setsid()/setpgid()
+  */
+ #define SB_POLL_MIN_MS 1
+ #define SB_POLL_MAX_MS 16
+ 
+ /*
+  * PER-CALL LIMITS (setrlimit in the child, right before f()):
+  * - mem_bytes: RLIMIT_AS, so a huge allocation fails instead of
+  *   dragging the host into swap; cpu_seconds: RLIMIT_CPU (SIGXCPU,
+  *   SIGKILL one second later); max_files: RLIMIT_NOFILE; no_core:
+  *   RLIMIT_CORE 0. Zero / false: not set
+  * - A process over RLIMIT_AS or RLIMIT_NOFILE is not killed, its
+  *   mmap()/open() just fail and f() usually crashes or exits on that.
+  *   To tell this apart from an ordinary crash, the child writes errno
+  *   to its sb_note (below) if it dies of a signal (SIGSEGV, SIGBUS,
+  *   SIGFPE, SIGABRT) with errno ENOMEM or EMFILE, or with the address
+  *   space too full to map 64 kB more. On exit() errno proves nothing
+  *   (f() may have recovered), so there it takes the limit still being
+  *   hit: no descriptor left, or no room for 64 kB
+  * - With no limit nothing of this happens: no setrlimit, no SIGABRT
+  *   handler, no atexit hook
+  */
+ #define SB_HEADROOM (64 * 1024)
+ 
+ typedef struct sandbox_limits {
+	 long long mem_bytes;
+	 int cpu_seconds;
+	 int max_files;
+	 bool no_core;
+ } sandbox_limits;
+ 
+ /*
+  * CRASH RECORDS:
+  * - Opt-in (opts->crash): the child then handles SIGSEGV, SIGBUS,
+  *   SIGFPE and SIGILL (which is also what compilers make of a provable
+  *   NULL store or __builtin_trap()) on an alternate stack. The handler
+  *   writes the signal, si_code, faulting address, pc and the top
+  *   SB_STACK_WORDS words of the faulting stack into the child's
+  *   sb_note, then re-raises with the default action, so the parent
+  *   still sees the signal
+  * - A run with limits installs the same handlers anyway (to note
+  *   errno, see PER-CALL LIMITS), and fork-server children inherit them
+  *   from the server, which installs them once: those runs always get
+  *   the record, at no extra cost
+  * - The parent decodes the note into sandbox_result.crash: the trace is
+  *   the pc followed by the stack words that point into executable
+  *   segments of its own image (the child is a fork, same layout), the
+  *   stack scan crash reporters fall back on. Frames are not unwound,
+  *   so a stale return address can show up; dladdr() / addr2line work
+  *   on the addresses as they are
+  * - Not backtrace(): it loads libgcc on first use, which a handler
+  *   must not do, and having it loaded up front makes every fork()
+  *   ~10% slower
+  * - sb_notes are slots of one MAP_SHARED region, mapped once per
+  *   process (again after a fork, e.g. in a fork server) and claimed
+  *   with atomic bit operations, so no run pays an mmap
+  * - A descendant that left the group outlives the run and still maps
+  *   its slot, which the next run may have claimed. Each claim stamps
+  *   the slot with a new generation, the child knows its own (like
+  *   sb_child_note, set before fork()), the handlers only write a slot
+  *   of their generation and mark the record with it, and the parent
+  *   ignores a record that is not of the current one
+  * - Why opt-in: sigaltstack() plus four sigaction() in every child
+  *   measured ~5% of a trivial sandbox_run() here. Installing them once
+  *   in the parent instead would swap the caller's own handlers for
+  *   ours, process-wide and racing with other threads, and restoring
+  *   them around each fork() costs more syscalls than it saves
+  */
+ #define SB_TRACE_MAX 16
+ #define SB_STACK_WORDS 64
+ #define SB_NOTE_SLOTS 1024
+ 
+ typedef struct sandbox_crash {
+	 int signo;                  // 0: no record
+	 int code;                   // si_code (SEGV_MAPERR, FPE_INTDIV...)
+	 void *addr;                 // si_addr
+	 void *pc;                   // Faulting instruction, NULL if unknown
+	 int depth;
+	 void *trace[SB_TRACE_MAX];  // pc, then likely return addresses
+ } sandbox_crash;
+ 
+ typedef struct sb_note {
+	 bool want_errno;  // Limits set: record errno at death
+	 uint32_t gen;     // Run the slot belongs to (set at claim)
+	 uint32_t written; // gen of the run that wrote died_errno / the record
+	 int died_errno;
+	 int signo;        // The crash record, 0: none
+	 int code;
+	 void *addr;
+	 void *pc;
+	 int nwords;       // Stack words copied from the faulting sp up
+	 uintptr_t stack[SB_STACK_WORDS];
+ } sb_note;
+ 
+ /*
+  * OUTPUT CAPTURE:
+  * - The child's stdout / stderr go to pipes instead of ours; the
+  *   supervisor drains them from the same epoll set it waits on, so a
+  *   chatty f() never blocks on a full pipe
+  * - Each stream lands in the caller's buffer, used as a ring: once f()
+  *   has written more than cap bytes the oldest go, truncated is set
+  *   and, at the end, buf is rotated so it reads in order (the last
+  *   len bytes of the total)
+  */
+ typedef struct sandbox_output {
+	 char *buf;
+	 size_t cap;
+	 size_t len;      // Bytes in buf once done
+	 size_t total;    // Bytes f() wrote
+	 bool truncated;  // total > cap
+ } sandbox_output;
+ 
+ /*
+  * RESULT CHANNEL (returning data from f):
+  * - sandbox_channel_open() maps cap bytes MAP_SHARED; with it in
+  *   opts->channel, f() gets the buffer from sandbox_channel_buf(),
+  *   writes its result there in place and calls
+  *   sandbox_channel_commit(len)
+  * - After a nice run ch->data points at those bytes inside the
+  *   mapping (nothing is copied) and ch->len says how many. Any other
+  *   verdict, or no commit, leaves data NULL and len 0: what a child
+  *   that crashed halfway wrote is never handed out
+  * - The length lives in the mapping too, and the parent checks it
+  *   against cap, so f() cannot make it read past the end
+  * - One mapping serves run after run: data stays valid until the next
+  *   run with the channel starts, or sandbox_channel_close()
+  */
+ #define SB_CHAN_DATA 64  // Header bytes before the data, keeps it cache-line aligned
+ 
+ typedef struct sandbox_channel {
+	 void *map;         // Header + cap bytes, MAP_SHARED
+	 size_t cap;
+	 const void *data;  // f()'s committed bytes after a nice run, NULL otherwise
+	 size_t len;
+ } sandbox_channel;
+ 
+ typedef struct sb_chan_head {
+	 size_t len;  // Committed length, SIZE_MAX: no commit
+ } sb_chan_head;
+ 
+ // Set right before fork() so only the child sees it (as sb_child_note)
+ static _Thread_local sandbox_channel *sb_child_channel;
+ 
+ int sandbox_channel_open(sandbox_channel *ch, size_t cap)
+ {
+	 ch->data = NULL;
+	 ch->len = 0;
+	 ch->cap = cap;
+	 ch->map = mmap(NULL, SB_CHAN_DATA + cap, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	 if (ch->map == MAP_FAILED)
+	 {
+		 ch->map = NULL;
+		 return -1;
+	 }
+	 ((sb_chan_head *)ch->map)->len = SIZE_MAX;
+	 return 0;
+ }
+ 
+ void sandbox_channel_close(sandbox_channel *ch)
+ {
+	 if (ch->map)
+		 munmap(ch->map, SB_CHAN_DATA + ch->cap);
+	 ch->map = NULL;
+	 ch->data = NULL;
+	 ch->len = 0;
+ }
+ 
+ // In f(): the buffer to write the result to, NULL if the run has no channel
+ void *sandbox_channel_buf(size_t *cap)
+ {
+	 sandbox_channel *ch = sb_child_channel;
+	 
+	 if (cap)
+		 *cap = ch ? ch->cap : 0;
+	 return ch ? (char *)ch->map + SB_CHAN_DATA : NULL;
+ }
+ 
+ // In f(): the first len bytes of the buffer are the result. 0, or -1 if len > cap.
+ int sandbox_channel_commit(size_t len)
+ {
+	 sandbox_channel *ch = sb_child_channel;
+	 
+	 if (!ch || len > ch->cap)
+	 {
+		 errno = ch ? EINVAL : EBADF;
+		 return -1;
+	 }
+	 ((sb_chan_head *)ch->map)->len = len;
+	 return 0;
+ }
+ 
+ // Options of one run; all zero: no timeout, no limits, no capture
+ typedef struct sandbox_opts {
+	 long long timeout_ns;  // 0: no limit
+	 bool verbose;
+	 sandbox_limits limits;
+	 sandbox_output *out;   // NULL: f() writes to our stdout
+	 sandbox_output *err;   // NULL: f() writes to our stderr
+	 sandbox_channel *channel;  // NULL: f() returns no data
+	 bool no_stop_poll;     // Stops wait for the deadline (see STOPS)
+	 bool crash;            // Record fatal signals (see CRASH RECORDS)
+ } sandbox_opts;
+ 
+ typedef struct sb_ring {
+	 sandbox_output *o;  // NULL: stream not captured
+	 int fd;             // Read end, -1 once at EOF
+	 size_t head;        // Next write position in o->buf
+ } sb_ring;
+ 
+ typedef struct sb_proc {
+	 pid_t pid;
+	 int pidfd;            // -1: no pidfd_open, child is polled
+	 int timerfd;
+	 int epfd;
+	 long long timeout_ns;  // 0: no timeout
+	 long long start_ns;    // Right before fork()
+	 long long deadline_ns;
+	 long long end_ns;      // Termination seen (or SIGKILL sent)
+	 int poll_ms;          // Stop (and fallback exit) polling interval, 0: none
+	 int status;           // waitpid() status once done
+	 struct rusage ru;     // wait4() usage once done
+	 sb_note *note;        // Shared with the child until reaped
+	 int died_errno;       // From the note once reaped, 0 if none
+	 sandbox_crash crash;  // From the note once reaped
+	 int cpu_seconds;
+	 sb_ring ring[2];      // stdout, stderr
+	 sandbox_channel *chan;  // NULL: no result channel
+	 int stop_sig;         // Signal that stopped it, 0 if none
+	 bool stops;           // Look for stops (!opts->no_stop_poll)
+	 bool timed_out;
+ } sb_proc;
+ 
+ static long long sb_now_ns(void)
+ {
+	 struct timespec ts;
+	 
+	 clock_gettime(CLOCK_MONOTONIC, &ts);
+	 return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+ }
+ 
+ static int sb_pidfd_open(pid_t pid)
+ {
+ #ifdef SYS_pidfd_open
+	 return syscall(SYS_pidfd_open, pid, 0);
+ #else
+	 (void)pid;
+	 errno = ENOSYS;
+	 return -1;
+ #endif
+ }
+ 
+ /*
+  * In the child, right after the dup2()s: f() starts with only 0, 1
+  * and 2. Whatever else the caller had open (other handles' epfd,
+  * timerfd, pidfd and pipes, sockets...) would otherwise count against
+  * limits.max_files and keep those pipes from reaching EOF
+  */
+ static void sb_close_from(int lo)
+ {
+	 struct rlimit rl;
+	 
+ #ifdef SYS_close_range
+	 if (syscall(SYS_close_range, lo, ~0U, 0) == 0)
+		 return;
+ #endif
+	 if (getrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur > 65536)
+		 rl.rlim_cur = 65536;
+	 for (int fd = lo; fd < (int)rl.rlim_cur; fd++)
+		 close(fd);
+ }
+ 
+ // Arms the timerfd at the deadline, or earlier for the next polling tick
+ static void sb_arm(sb_proc *p)
+ {
+	 struct itimerspec its;
+	 long long at = p->deadline_ns;
+	 long long tick;
+	 
+	 tick = sb_now_ns() + p->poll_ms * 1000000LL;
+	 if (p->poll_ms && (!at || tick < at))
+		 at = tick;
+	 memset(&its, 0, sizeof(its));
+	 its.it_value.tv_sec = at / 1000000000LL;
+	 its.it_value.tv_nsec = at % 1000000000LL;
+	 timerfd_settime(p->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+ }
+ 
+ static struct {
+	 sb_note *notes;
+	 pid_t owner;                          // Process the slots belong to
+	 uint64_t used[SB_NOTE_SLOTS / 64];
+	 uint32_t gen;                         // Last generation handed out
+	 bool lock;
+ } sb_pool;
+ 
+ static void sb_pool_init(pid_t me)
+ {
+	 struct sigaction sa;
+	 stack_t ss;
+	 
+	 while (__atomic_test_and_set(&sb_pool.lock, __ATOMIC_ACQUIRE))
+		 ;
+	 if (sb_pool.owner != me)
+	 {
+		 if (sb_pool.notes)
+			 munmap(sb_pool.notes, SB_NOTE_SLOTS * sizeof(sb_note));  // Parent's
+		 sb_pool.notes = mmap(NULL, SB_NOTE_SLOTS * sizeof(sb_note),
+			 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		 if (sb_pool.notes == MAP_FAILED)
+			 sb_pool.notes = NULL;
+		 memset(sb_pool.used, 0, sizeof(sb_pool.used));
+		 // Bind the PLT entries here, not in every child (GOT write + lookup)
+		 sigaltstack(NULL, &ss);
+		 sigaction(SIGSEGV, NULL, &sa);
+		 __atomic_store_n(&sb_pool.owner, me, __ATOMIC_RELEASE);
+	 }
+	 __atomic_clear(&sb_pool.lock, __ATOMIC_RELEASE);
+ }
+ 
+ // A zeroed note: a pool slot, or a page of its own if the pool is full
+ static sb_note *sb_note_claim(void)
+ {
+	 pid_t me = getpid();
+	 sb_note *n = NULL;
+	 uint64_t w;
+	 int bit;
+	 
+	 if (__atomic_load_n(&sb_pool.owner, __ATOMIC_ACQUIRE) != me)
+		 sb_pool_init(me);
+	 for (int i = 0; sb_pool.notes && !n && i < SB_NOTE_SLOTS / 64; i++)
+	 {
+		 w = __atomic_load_n(&sb_pool.used[i], __ATOMIC_RELAXED);
+		 while (!n && w != ~0ULL)
+		 {
+			 bit = __builtin_ctzll(~w);
+			 if (__atomic_compare_exchange_n(&sb_pool.used[i], &w, w | 1ULL << bit, false,
+				 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+				 n = &sb_pool.notes[i * 64 + bit];
+		 }
+	 }
+	 if (!n)
+	 {
+		 n = mmap(NULL, sizeof(*n), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		 if (n == MAP_FAILED)
+			 return NULL;
+	 }
+	 memset(n, 0, sizeof(*n));
+	 n->gen = __atomic_add_fetch(&sb_pool.gen, 1, __ATOMIC_RELAXED);
+	 if (!n->gen)
+		 n->gen = __atomic_add_fetch(&sb_pool.gen, 1, __ATOMIC_RELAXED);  // 0: unwritten
+	 return n;
+ }
+ 
+ static void sb_note_release(sb_note *n)
+ {
+	 size_t i;
+	 
+	 if (sb_pool.notes && n >= sb_pool.notes && n < sb_pool.notes + SB_NOTE_SLOTS)
+	 {
+		 i = n - sb_pool.notes;
+		 __atomic_fetch_and(&sb_pool.used[i / 64], ~(1ULL << (i % 64)), __ATOMIC_RELEASE);
+	 }
+	 else
+		 munmap(n, sizeof(*n));
+ }
+ 
+ static void sb_close(sb_proc *p)
+ {
+	 if (p->pidfd != -1)
+		 close(p->pidfd);
+	 if (p->timerfd != -1)
+		 close(p->timerfd);
+	 if (p->epfd != -1)
+		 close(p->epfd);
+	 if (p->note)
+		 sb_note_release(p->note);
+	 p->note = NULL;
+	 for (int i = 0; i < 2; i++)
+	 {
+		 if (p->ring[i].fd != -1)
+			 close(p->ring[i].fd);
+		 p->ring[i].fd = -1;
+	 }
+	 p->pidfd = -1;
+	 p->timerfd = -1;
+	 p->epfd = -1;
+ }
+ 
+ /*
+  * DEADLINE INSIDE THE CHILD:
+  * - A POSIX timer on CLOCK_MONOTONIC that delivers SIGKILL to the
+  *   child itself at the (absolute) deadline: the kernel kills it from
+  *   the timer interrupt, without waiting for the supervisor to be
+  *   scheduled, which matters when f() spins on the only free CPU
+  * - The supervisor's timerfd stays armed as a backstop (f() could
+  *   delete the timer, exec...); a SIGKILL seen after the deadline
+  *   counts as a timeout
+  */
+ static void sb_self_timer(long long deadline_ns)
+ {
+	 struct sigevent sev;
+	 struct itimerspec its;
+	 timer_t timer;
+	 
+	 memset(&sev, 0, sizeof(sev));
+	 sev.sigev_notify = SIGEV_SIGNAL;
+	 sev.sigev_signo = SIGKILL;
+	 memset(&its, 0, sizeof(its));
+	 its.it_value.tv_sec = deadline_ns / 1000000000LL;
+	 its.it_value.tv_nsec = deadline_ns % 1000000000LL;
+	 if (timer_create(CLOCK_MONOTONIC, &sev, &timer) == 0)
+		 timer_settime(timer, TIMER_ABSTIME, &its, NULL);
+ }
+ 
+ /*
+  * CRASH AND LIMIT BOOKKEEPING IN THE CHILD:
+  * - The handlers run on their own stack (a stack overflow is a
+  *   SIGSEGV too), fill the note, then re-raise with the default action
+  *   (SA_RESETHAND) so the parent still sees the original signal
+  * - They find the note through a thread-local the parent sets right
+  *   before fork(), as sandbox_measure() does: the child writes nothing
+  *   for it, so no copy-on-write fault on the nice path
+  */
+ static _Thread_local sb_note *sb_child_note;
+ static _Thread_local uint32_t sb_child_gen;
+ 
+ // Is the child at a limit right now? EMFILE, ENOMEM (no room for 64 kB more) or 0
+ static int sb_limit_now(void)
+ {
+	 void *probe;
+	 int fd;
+	 
+	 fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	 if (fd == -1 && errno == EMFILE)
+		 return EMFILE;
+	 if (fd != -1)
+		 close(fd);
+	 probe = mmap(NULL, SB_HEADROOM, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	 if (probe == MAP_FAILED)
+		 return ENOMEM;
+	 munmap(probe, SB_HEADROOM);
+	 return 0;
+ }
+ 
+ static void sb_note_limit(int err)
+ {
+	 if ((err == ENOMEM || err == EMFILE) && sb_child_note->gen == sb_child_gen)
+	 {
+		 sb_child_note->died_errno = err;
+		 sb_child_note->written = sb_child_gen;
+	 }
+ }
+ 
+ // Fatal signal: right after the failure, so errno is trusted as is
+ static void sb_note_errno(void)
+ {
+	 int err = errno;
+	 
+	 sb_note_limit(err == ENOMEM || err == EMFILE ? err : sb_limit_now());
+	 errno = err;
+ }
+ 
+ /*
+  * exit(): errno may be left over from a failure f() got past, followed
+  * by an unrelated exit(1), so only a limit still hit now counts
+  */
+ static void sb_note_exit(void)
+ {
+	 int err = errno;
+	 
+	 sb_note_limit(sb_limit_now());
+	 errno = err;
+ }
+ 
+ /*
+  * The stack is copied last and word by word: if sp is so close to the
+  * top of its mapping that the copy faults, the child dies of SIGSEGV
+  * (already reset to default) with the rest of the record in place
+  */
+ static void sb_fatal_handler(int sig, siginfo_t *si, void *uctx)
+ {
+	 sb_note *n = sb_child_note;
+	 ucontext_t *uc = uctx;
+	 uintptr_t *sp = NULL;
+	 int err = errno;
+	 
+	 if (!n || getpid() == sb_pool.owner || n->gen != sb_child_gen)
+	 {
+		 raise(sig);  // A fork server crashing itself, or the slot is another run's
+		 return;
+	 }
+	 if (sig != SIGABRT)
+	 {
+		 n->written = sb_child_gen;
+		 n->signo = sig;
+		 n->code = si->si_code;
+		 n->addr = si->si_addr;
+ #if defined(__x86_64__)
+		 n->pc = (void *)uc->uc_mcontext.gregs[REG_RIP];
+		 sp = (uintptr_t *)uc->uc_mcontext.gregs[REG_RSP];
+ #elif defined(__aarch64__)
+		 n->pc = (void *)uc->uc_mcontext.pc;
+		 sp = (uintptr_t *)uc->uc_mcontext.sp;
+ #else
+		 (void)uc;
+ #endif
+		 for (int i = 0; sp && i < SB_STACK_WORDS; i++)
+		 {
+			 n->stack[i] = sp[i];
+			 n->nwords = i + 1;
+		 }
+	 }
+	 errno = err;
+	 if (n->want_errno)
+		 sb_note_errno();
+	 raise(sig);
+ }
+ 
+ /*
+  * crash: alternate stack and the SIGSEGV / SIGBUS / SIGFPE / SIGILL
+  * handlers; abort: the SIGABRT one. A fork server installs the crash
+  * ones once in itself: alternate stack and handlers survive fork(),
+  * so its children skip those syscalls
+  */
+ static bool sb_handlers_inherited;
+ 
+ static void sb_install_handlers(bool crash, bool abort)
+ {
+	 static char altstack[64 * 1024];
+	 static const int crash_sigs[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL};
+	 struct sigaction sa;
+	 stack_t ss;
+	 
+	 memset(&sa, 0, sizeof(sa));
+	 sa.sa_sigaction = sb_fatal_handler;
+	 sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESETHAND;
+	 sigemptyset(&sa.sa_mask);
+	 if (crash)
+	 {
+		 ss.ss_sp = altstack;
+		 ss.ss_size = sizeof(altstack);
+		 ss.ss_flags = 0;
+		 sigaltstack(&ss, NULL);
+		 for (int i = 0; i < (int)(sizeof(crash_sigs) / sizeof(crash_sigs[0])); i++)
+			 sigaction(crash_sigs[i], &sa, NULL);
+	 }
+	 if (abort)
+		 sigaction(SIGABRT, &sa, NULL);
+ }
+ 
+ /*
+  * Right before f(): limits, then the fatal-signal handlers (SIGABRT
+  * and the atexit hook only to spot limits)
+  */
+ static void sb_child_setup(const sandbox_limits *lim, bool want_errno, bool crash)
+ {
+	 struct rlimit rl;
+	 
+	 if (lim->mem_bytes > 0)
+	 {
+		 rl.rlim_cur = rl.rlim_max = lim->mem_bytes;
+		 setrlimit(RLIMIT_AS, &rl);
+	 }
+	 if (lim->cpu_seconds > 0)
+	 {
+		 rl.rlim_cur = lim->cpu_seconds;
+		 rl.rlim_max = lim->cpu_seconds + 1;
+		 setrlimit(RLIMIT_CPU, &rl);
+	 }
+	 if (lim->max_files > 0)
+	 {
+		 rl.rlim_cur = rl.rlim_max = lim->max_files;
+		 setrlimit(RLIMIT_NOFILE, &rl);
+	 }
+	 if (lim->no_core)
+	 {
+		 rl.rlim_cur = rl.rlim_max = 0;
+		 setrlimit(RLIMIT_CORE, &rl);
+	 }
+	 sb_install_handlers((want_errno || crash) && !sb_handlers_inherited, want_errno);
+	 if (want_errno)
+		 atexit(sb_note_exit);
+ }
+ 
+ /*
+  * Reads whatever r's pipe holds into the ring, straight into o->buf.
+  * Stops at EAGAIN, after max_reads reads (-1: no cap, so a child that
+  * writes nonstop cannot hold up its deadline), or at EOF, where the
+  * pipe is closed (it would otherwise stay ready forever in the epoll
+  * set).
+  */
+ static void sb_drain(sb_ring *r, int epfd, int max_reads)
+ {
+	 char discard[4096];
+	 ssize_t n;
+	 
+	 while (r->fd != -1 && max_reads-- != 0)
+	 {
+		 if (r->o->cap)
+			 n = read(r->fd, r->o->buf + r->head, r->o->cap - r->head);
+		 else
+			 n = read(r->fd, discard, sizeof(discard));
+		 if (n == -1 && errno == EINTR)
+			 continue;
+		 if (n == -1 && errno == EAGAIN)
+			 return;
+		 if (n <= 0)
+		 {
+			 epoll_ctl(epfd, EPOLL_CTL_DEL, r->fd, NULL);
+			 close(r->fd);
+			 r->fd = -1;
+			 return;
+		 }
+		 r->o->total += n;
+		 if (r->o->cap)
+			 r->head = (r->head + n) % r->o->cap;
+	 }
+ }
+ 
+ static void sb_reverse(char *a, size_t n)
+ {
+	 char c;
+	 
+	 for (size_t i = 0; i < n / 2; i++)
+	 {
+		 c = a[i];
+		 a[i] = a[n - 1 - i];
+		 a[n - 1 - i] = c;
+	 }
+ }
+ 
+ // Puts a wrapped ring back in order: oldest byte (at head) first
+ static void sb_unwrap(sb_ring *r)
+ {
+	 sandbox_output *o = r->o;
+	 
+	 o->truncated = o->total > o->cap;
+	 o->len = o->truncated ? o->cap : o->total;
+	 if (!o->truncated || !r->head)
+		 return;
+	 sb_reverse(o->buf, r->head);
+	 sb_reverse(o->buf + r->head, o->cap - r->head);
+	 sb_reverse(o->buf, o->cap);
+ }
+ 
+ /*
+  * Forks f() under opts and sets up its descriptors. Returns 0, or -1
+  * (nothing left running) on error.
+  */
+ static int sb_spawn(sb_proc *p, void (*f)(void), const sandbox_opts *opts)
+ {
+	 const sandbox_limits *lim = &opts->limits;
+	 long long timeout_ns = opts->timeout_ns;
+	 struct epoll_event ev;
+	 int pipes[2][2];
+	 
+	 memset(p, 0, sizeof(*p));
+	 p->pidfd = -1;
+	 p->ring[0].fd = -1;
+	 p->ring[1].fd = -1;
+	 p->ring[0].o = opts->out;
+	 p->ring[1].o = opts->err;
+	 p->chan = opts->channel;
+	 p->stops = !opts->no_stop_poll;
+	 p->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	 p->epfd = epoll_create1(EPOLL_CLOEXEC);
+	 if (p->timerfd == -1 || p->epfd == -1)
+	 {
+		 sb_close(p);
+		 return -1;
+	 }
+	 p->note = sb_note_claim();
+	 if (!p->note)
+	 {
+		 sb_close(p);
+		 return -1;
+	 }
+	 p->note->want_errno = lim->mem_bytes > 0 || lim->max_files > 0;
+	 p->cpu_seconds = lim->cpu_seconds;
+	 for (int i = 0; i < 2; i++)
+	 {
+		 if (!p->ring[i].o)
+			 continue;
+		 p->ring[i].o->len = 0;
+		 p->ring[i].o->total = 0;
+		 p->ring[i].o->truncated = false;
+		 if (pipe2(pipes[i], O_CLOEXEC) == -1)
+		 {
+			 if (i == 1 && p->ring[0].o)
+				 close(pipes[0][1]);
+			 sb_close(p);
+			 return -1;
+		 }
+		 p->ring[i].fd = pipes[i][0];
+	 }
+	 if (p->chan)
+	 {
+		 p->chan->data = NULL;
+		 p->chan->len = 0;
+		 ((sb_chan_head *)p->chan->map)->len = SIZE_MAX;
+	 }
+	 fflush(NULL);  // The child must not repeat our buffered output
+	 p->start_ns = sb_now_ns();
+	 p->timeout_ns = timeout_ns > 0 ? timeout_ns : 0;
+	 p->deadline_ns = timeout_ns > 0 ? p->start_ns + timeout_ns : 0;
+	 sb_child_note = p->note;
+	 sb_child_gen = p->note->gen;
+	 sb_child_channel = p->chan;
+	 p->pid = fork();
+	 if (p->pid != 0)
+		 sb_child_channel = NULL;  // sandbox_channel_buf() is for f() only
+	 for (int i = 0; i < 2 && p->pid != 0; i++)
+		 if (p->ring[i].o)
+			 close(pipes[i][1]);
+	 if (p->pid == -1)
+	 {
+		 sb_close(p);
+		 return -1;
+	 }
+	 if (p->pid == 0)
+	 {
+		 for (int i = 0; i < 2; i++)
+			 if (p->ring[i].o)
+				 dup2(pipes[i][1], STDOUT_FILENO + i);  // Drops O_CLOEXEC
+		 sb_close_from(STDERR_FILENO + 1);
+		 setpgid(0, 0);
+		 if (p->deadline_ns)
+			 sb_self_timer(p->deadline_ns);
+		 sb_child_setup(lim, p->note->want_errno, opts->crash);
+		 f();
+		 exit(0);
+	 }
+	 setpgid(p->pid, p->pid);
+	 p->pidfd = sb_pidfd_open(p->pid);
+	 p->poll_ms = (p->stops || p->pidfd == -1) ? SB_POLL_MIN_MS : 0;
+	 ev.events = EPOLLIN;
+	 ev.data.fd = p->timerfd;
+	 epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->timerfd, &ev);
+	 if (p->pidfd != -1)
+	 {
+		 ev.data.fd = p->pidfd;
+		 epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->pidfd, &ev);
+	 }
+	 for (int i = 0; i < 2; i++)
+	 {
+		 if (p->ring[i].fd == -1)
+			 continue;
+		 fcntl(p->ring[i].fd, F_SETFL, O_NONBLOCK);
+		 ev.data.fd = p->ring[i].fd;
+		 epoll_ctl(p->epfd, EPOLL_CTL_ADD, p->ring[i].fd, &ev);
+	 }
+	 sb_arm(p);
+	 return 0;
+ }
+ 
+ // Executable PT_LOAD segments of every loaded object
+ typedef struct sb_text {
+	 uintptr_t lo[64];
+	 uintptr_t hi[64];
+	 int n;
+ } sb_text;
+ 
+ static int sb_text_add(struct dl_phdr_info *info, size_t size, void *data)
+ {
+	 sb_text *t = data;
+	 
+	 (void)size;
+	 for (int i = 0; i < info->dlpi_phnum && t->n < 64; i++)
+	 {
+		 if (info->dlpi_phdr[i].p_type != PT_LOAD || !(info->dlpi_phdr[i].p_flags & PF_X))
+			 continue;
+		 t->lo[t->n] = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+		 t->hi[t->n] = t->lo[t->n] + info->dlpi_phdr[i].p_memsz;
+		 t->n++;
+	 }
+	 return 0;
+ }
+ 
+ // Crash record of a note (parent side, only when there is one)
+ static void sb_decode_crash(const sb_note *n, sandbox_crash *c)
+ {
+	 sb_text text;
+	 
+	 memset(c, 0, sizeof(*c));
+	 if (!n->signo)
+		 return;
+	 c->signo = n->signo;
+	 c->code = n->code;
+	 c->addr = n->addr;
+	 c->pc = n->pc;
+	 if (c->pc)
+		 c->trace[c->depth++] = c->pc;
+	 text.n = 0;
+	 dl_iterate_phdr(sb_text_add, &text);
+	 for (int i = 0; i < n->nwords && c->depth < SB_TRACE_MAX; i++)
+		 for (int k = 0; k < text.n; k++)
+			 if (n->stack[i] >= text.lo[k] && n->stack[i] < text.hi[k])
+			 {
+				 c->trace[c->depth++] = (void *)n->stack[i];
+				 break;
+			 }
+ }
+ 
+ /*
+  * Does whatever is pending for p without blocking. Returns 1 once the
+  * child has been reaped (p->status / p->timed_out are final; the owner
+  * then calls sb_close), 0 while it is still running.
+  */
+ static int sb_step(sb_proc *p)
+ {
+	 uint64_t ticks;
+	 siginfo_t si;
+	 pid_t r;
+	 
+	 if (read(p->timerfd, &ticks, sizeof(ticks)) == -1)
+		 ticks = 0;  // EAGAIN: woken by the pidfd or a pipe, not the timer
+	 for (int i = 0; i < 2; i++)
+		 sb_drain(&p->ring[i], p->epfd, 16);
+	 si.si_pid = 0;
+	 if (waitid(P_PID, p->pid, &si, WEXITED | WNOHANG | WNOWAIT
+		 | (p->stops ? WSTOPPED : 0)) == -1)
+		 si.si_pid = -1;
+	 p->end_ns = sb_now_ns();
+	 if (si.si_pid > 0 && si.si_code == CLD_STOPPED)
+		 p->stop_sig = si.si_status;
+	 else if (si.si_pid == 0 && p->deadline_ns && p->end_ns >= p->deadline_ns)
+		 p->timed_out = true;
+	 else if (si.si_pid == 0)
+	 {
+		 if (p->poll_ms && p->poll_ms < SB_POLL_MAX_MS)
+			 p->poll_ms *= 2;
+		 sb_arm(p);
+		 return 0;
+	 }
+	 kill(-p->pid, SIGKILL);  // The child (if still running or stopped) and its descendants
+	 r = wait4(p->pid, &p->status, 0, &p->ru);  // Collect zombie process
+	 if (r > 0 && !p->timed_out && p->deadline_ns && p->end_ns >= p->deadline_ns
+		 && WIFSIGNALED(p->status) && WTERMSIG(p->status) == SIGKILL)
+		 p->timed_out = true;  // Killed by its own deadline timer
+	 if (r == -1)
+		 p->status = -1;
+	 if (p->note->written == p->note->gen)  // Else a late write from an older run
+	 {
+		 p->died_errno = p->note->died_errno;
+		 sb_decode_crash(p->note, &p->crash);
+	 }
+	 for (int i = 0; i < 2; i++)
+	 {
+		 if (!p->ring[i].o)
+			 continue;
+		 sb_drain(&p->ring[i], p->epfd, -1);  // What the tree wrote before dying
+		 sb_unwrap(&p->ring[i]);
+	 }
+	 return 1;
+ }
+ 
+ // Blocks until p is done
+ static void sb_wait(sb_proc *p)
+ {
+	 struct epoll_event ev;
+	 
+	 while (!sb_step(p))
+		 epoll_wait(p->epfd, &ev, 1, -1);
+	 sb_close(p);
+ }
+ 
+ /*
+  * RESULT OF A RUN (sandbox_run):
+  * - verdict: 1 nice, 0 bad, -1 error, as sandbox() returns
+  * - reason and code say why: exit code for SB_EXITED, signal number
+  *   for SB_SIGNALED
+  * - runtime_ns: wall-clock time from fork() until the supervisor saw
+  *   the child terminate, so a timed-out run shows timeout + overshoot
+  * - The rest is the child's struct rusage from wait4(): CPU time, peak
+  *   RSS, page faults and context switches, so a nice but slow or
+  *   memory-hungry f() can be flagged (f's own children are not
+  *   counted unless it waited for them)
+  * - crash: the record of a SIGSEGV / SIGBUS / SIGFPE / SIGILL (see
+  *   CRASH RECORDS), crash.signo == 0 otherwise or if not asked for
+  */
+ enum {
+	 SB_NICE,
+	 SB_EXITED,
+	 SB_SIGNALED,
+	 SB_TIMEOUT,
+	 SB_ERROR,
+	 SB_MEM_LIMIT,   // code: exit code or signal it died with
+	 SB_CPU_LIMIT,   // code: signal
+	 SB_FILE_LIMIT,  // code: exit code or signal it died with
+	 SB_STOPPED      // code: stop signal
+ };
+ 
+ typedef struct sandbox_result {
+	 int verdict;
+	 int reason;
+	 int code;
+	 long long runtime_ns;
+	 long long utime_ns;   // User CPU time
+	 long long stime_ns;   // System CPU time
+	 long maxrss_kb;       // Peak resident set size
+	 long minflt;          // Page faults served without I/O
+	 long majflt;          // Page faults that needed I/O
+	 long nvcsw;           // Voluntary context switches (blocked)
+	 long nivcsw;          // Involuntary context switches (preempted)
+	 sandbox_crash crash;
+ } sandbox_result;
+ 
+ static int sb_ll_cmp(const void *a, const void *b)
+ {
+	 long long x = *(const long long *)a;
+	 long long y = *(const long long *)b;
+	 
+	 return (x > y) - (x < y);
+ }
+ 
+ /*
+  * Prints the verdict: same messages as sandbox(), but a timeout that
+  * is not a whole number of seconds is printed in milliseconds
+  */
+ static void sb_print(const sandbox_result *res, long long timeout_ns)
+ {
+	 if (res->reason == SB_NICE)
+		 printf("Nice function!\n");
+	 else if (res->reason == SB_EXITED)
+		 printf("Bad function: exited with code %d\n", res->code);
+	 else if (res->reason == SB_SIGNALED || res->reason == SB_STOPPED)
+		 printf("Bad function: %s\n", strsignal(res->code));
+	 else if (res->reason == SB_TIMEOUT && timeout_ns % 1000000000LL == 0)
+		 printf("Bad function: timed out after %lld seconds\n", timeout_ns / 1000000000LL);
+	 else if (res->reason == SB_TIMEOUT)
+		 printf("Bad function: timed out after %g ms\n", timeout_ns / 1e6);
+	 else if (res->reason == SB_MEM_LIMIT)
+		 printf("Bad function: exceeded memory limit\n");
+	 else if (res->reason == SB_CPU_LIMIT)
+		 printf("Bad function: exceeded CPU time limit\n");
+	 else if (res->reason == SB_FILE_LIMIT)
+		 printf("Bad function: exceeded open files limit\n");
+ }
+ 
+ // Fills res from a finished sb_proc and prints the message if asked
+ static int sb_result(const sb_proc *p, bool verbose, sandbox_result *res)
+ {
+	 memset(res, 0, sizeof(*res));
+	 res->runtime_ns = p->end_ns - p->start_ns;
+	 res->utime_ns = p->ru.ru_utime.tv_sec * 1000000000LL + p->ru.ru_utime.tv_usec * 1000LL;
+	 res->stime_ns = p->ru.ru_stime.tv_sec * 1000000000LL + p->ru.ru_stime.tv_usec * 1000LL;
+	 res->maxrss_kb = p->ru.ru_maxrss;
+	 res->minflt = p->ru.ru_minflt;
+	 res->majflt = p->ru.ru_majflt;
+	 res->nvcsw = p->ru.ru_nvcsw;
+	 res->nivcsw = p->ru.ru_nivcsw;
+	 res->crash = p->crash;
+	 res->verdict = 0;
+	 if (p->stop_sig)
+	 {
+		 res->code = p->stop_sig;
+		 res->reason = SB_STOPPED;
+	 }
+	 else if (p->timed_out)
+		 res->reason = SB_TIMEOUT;
+	 else if (p->status == -1)
+		 res->reason = SB_ERROR;
+	 else if (WIFEXITED(p->status))
+	 {
+		 res->code = WEXITSTATUS(p->status);
+		 res->reason = res->code ? SB_EXITED : SB_NICE;
+	 }
+	 else if (WIFSIGNALED(p->status))
+	 {
+		 res->code = WTERMSIG(p->status);
+		 res->reason = SB_SIGNALED;
+	 }
+	 else
+		 res->reason = SB_ERROR;
+	 if (res->reason == SB_SIGNALED && p->cpu_seconds && (res->code == SIGXCPU
+		 || (res->code == SIGKILL && res->utime_ns + res->stime_ns
+			 >= p->cpu_seconds * 1000000000LL)))
+		 res->reason = SB_CPU_LIMIT;
+	 else if ((res->reason == SB_SIGNALED || res->reason == SB_EXITED)
+		 && p->died_errno == ENOMEM)
+		 res->reason = SB_MEM_LIMIT;
+	 else if ((res->reason == SB_SIGNALED || res->reason == SB_EXITED)
+		 && p->died_errno == EMFILE)
+		 res->reason = SB_FILE_LIMIT;
+	 if (res->reason == SB_NICE)
+		 res->verdict = 1;
+	 if (res->reason == SB_NICE && p->chan)
+	 {
+		 size_t len = ((volatile sb_chan_head *)p->chan->map)->len;
+		 
+		 if (len <= p->chan->cap)
+		 {
+			 p->chan->data = (char *)p->chan->map + SB_CHAN_DATA;
+			 p->chan->len = len;
+		 }
+	 }
+	 if (res->reason == SB_ERROR)
+		 res->verdict = -1;
+	 if (verbose)
+		 sb_print(res, p->timeout_ns);
+	 return res->verdict;
+ }
+ 
+ /*
+  * HIGH-RESOLUTION SANDBOX:
+  * - Timeout in nanoseconds, CLOCK_MONOTONIC: the child's own timer
+  *   kills it at the deadline and the supervisor notices through the
+  *   pidfd, tens of microseconds later (checked by the bench gate)
+  * - opts == NULL: no timeout, not verbose; res may be NULL
+  */
+ int sandbox_run(void (*f)(void), const sandbox_opts *opts, sandbox_result *res)
+ {
+	 static const sandbox_opts defaults;
+	 sandbox_result tmp;
+	 sb_proc p;
+	 
+	 if (!opts)
+		 opts = &defaults;
+	 if (!res)
+		 res = &tmp;
+	 if (sb_spawn(&p, f, opts) == -1)
+	 {
+		 memset(res, 0, sizeof(*res));
+		 res->verdict = -1;
+		 res->reason = SB_ERROR;
+		 return -1;
+	 }
+	 sb_wait(&p);
+	 return sb_result(&p, opts->verbose, res);
+ }
+ 
+ /*
+  * THREAD-SAFE SANDBOX:
+  * - Same contract as sandbox(), built on sb_proc
+  */
+ int sandbox_mt(void (*f)(void), unsigned int timeout, bool verbose)
+ {
+	 sandbox_opts opts;
+	 
+	 memset(&opts, 0, sizeof(opts));
+	 opts.timeout_ns = timeout * 1000000000LL;
+	 opts.verbose = verbose;
+	 return sandbox_run(f, &opts, NULL);
+ }
+ 
+ /*
+  * SANDBOX MANY (bounded worker pool):
+  * - Runs fns[0..n-1] with up to `parallelism` children alive at once
+  *   and stores each verdict (1, 0 or -1, as sandbox()) in results[i]
+  * - Each child gets its own deadline, so a 10k run takes about
+  *   sum(runtimes) / parallelism instead of the sum
+  * - Every running child's epfd sits in one pool epoll; a wakeup
+  *   points straight at the sb_proc that needs sb_step()
+  * - Returns the number of nice functions, or -1 on bad arguments
+  */
+ int sandbox_many(void (**fns)(void), int n, unsigned int timeout, int parallelism,
+	 int *results)
+ {
+	 struct epoll_event ev[16];
+	 sandbox_opts opts = {.timeout_ns = timeout * 1000000000LL};
+	 sandbox_result res;
+	 sb_proc *procs;
+	 int *index;           // Position in fns/results of each slot
+	 int pool;
+	 int next = 0;
+	 int running = 0;
+	 int nice = 0;
+	 int ready;
+	 int i;
+	 
+	 if (n < 0 || parallelism <= 0 || (n && (!fns || !results)))
+		 return -1;
+	 procs = calloc(parallelism, sizeof(*procs));
+	 index = malloc(parallelism * sizeof(*index));
+	 pool = epoll_create1(EPOLL_CLOEXEC);
+	 if (!procs || !index || pool == -1)
+	 {
+		 free(procs);
+		 free(index);
+		 if (pool != -1)
+			 close(pool);
+		 return -1;
+	 }
+	 for (i = 0; i < parallelism; i++)
+		 index[i] = -1;
+	 
+	 while (next < n || running > 0)
+	 {
+		 // FILL FREE SLOTS
+		 for (i = 0; i < parallelism && next < n; i++)
+		 {
+			 if (index[i] != -1)
+				 continue;
+			 if (sb_spawn(&procs[i], fns[next], &opts) == -1)
+			 {
+				 results[next++] = -1;
+				 continue;
+			 }
+			 index[i] = next++;
+			 ev[0].events = EPOLLIN;
+			 ev[0].data.u32 = i;
+			 epoll_ctl(pool, EPOLL_CTL_ADD, procs[i].epfd, &ev[0]);
+			 running++;
+		 }
+		 if (!running)
+			 continue;
+		 
+		 // COLLECT THE CHILDREN THAT HAVE NEWS
+		 ready = epoll_wait(pool, ev, 16, -1);
+		 for (int k = 0; k < ready; k++)
+		 {
+			 i = ev[k].data.u32;
+			 if (index[i] == -1 || !sb_step(&procs[i]))
+				 continue;
+			 /*
+			  * Leave the pool explicitly: later children inherit a copy
+			  * of this epfd, so close() alone would not drop it from the
+			  * pool and it would stay ready forever
+			  */
+			 epoll_ctl(pool, EPOLL_CTL_DEL, procs[i].epfd, NULL);
+			 sb_close(&procs[i]);
+			 results[index[i]] = sb_result(&procs[i], false, &res);
+			 nice += results[index[i]] == 1;
+			 index[i] = -1;
+			 running--;
+		 }
+	 }
+	 close(pool);
+	 free(procs);
+	 free(index);
+	 return nice;
+ }
+ 
+ /*
+  * ASYNCHRONOUS SANDBOX:
+  * - sandbox_start() forks f() and returns at once with a handle;
+  *   sandbox_fd() is the child's epfd, readable whenever sandbox_poll()
+  *   has something to do, so it drops into any epoll/poll loop and one
+  *   thread can supervise as many sandboxes as it has descriptors
+  * - sandbox_poll() never blocks: 0 while f() runs, 1 once it is over
+  *   and res is filled (and printed if opts->verbose); sandbox_wait()
+  *   blocks and returns the verdict
+  * - sandbox_free() releases the handle; a still-running child and its
+  *   group are killed and reaped first, so nothing leaks. Take
+  *   sandbox_fd() out of your epoll set before that: children forked
+  *   meanwhile hold copies of it, so closing it alone would not drop it
+  *   from the set (same as in sandbox_many())
+  * - sandbox_pid() is the child's pid, also its process group id (to
+  *   log it or signal the group); the handle reaps it, never wait for
+  *   it yourself
+  * - opts->out / opts->err / opts->channel must stay valid until the
+  *   run is over
+  * - Each live handle costs the caller descriptors: the epfd, the
+  *   timerfd, the pidfd and one pipe end per captured stream (3 to 5),
+  *   all against RLIMIT_NOFILE, so with the default 1024 a single
+  *   thread tops out around 250-340 concurrent sandboxes. f() itself
+  *   starts with only 0, 1 and 2 open, so none of them count against
+  *   its limits.max_files
+  * - (The harvest call is sandbox_poll(), sandbox_result being the
+  *   name of the result struct)
+  */
+ typedef struct sandbox_handle {
+	 sb_proc p;
+	 bool verbose;
+	 bool done;
+ } sandbox_handle;
+ 
+ sandbox_handle *sandbox_start(void (*f)(void), const sandbox_opts *opts)
+ {
+	 static const sandbox_opts defaults;
+	 sandbox_handle *h;
+	 
+	 if (!opts)
+		 opts = &defaults;
+	 h = malloc(sizeof(*h));
+	 if (!h)
+		 return NULL;
+	 if (sb_spawn(&h->p, f, opts) == -1)
+	 {
+		 free(h);
+		 return NULL;
+	 }
+	 h->verbose = opts->verbose;
+	 h->done = false;
+	 return h;
+ }
+ 
+ int sandbox_fd(const sandbox_handle *h)
+ {
+	 return h->p.epfd;
+ }
+ 
+ pid_t sandbox_pid(const sandbox_handle *h)
+ {
+	 return h->p.pid;
+ }
+ 
+ int sandbox_poll(sandbox_handle *h, sandbox_result *res)
+ {
+	 sandbox_result tmp;
+	 
+	 if (!res)
+		 res = &tmp;
+	 if (!h->done && !sb_step(&h->p))
+		 return 0;
+	 if (!h->done)
+	 {
+		 h->done = true;
+		 sb_result(&h->p, h->verbose, res);
+		 h->verbose = false;  // Print once
+	 }
+	 else
+		 sb_result(&h->p, false, res);
+	 return 1;
+ }
+ 
+ int sandbox_wait(sandbox_handle *h, sandbox_result *res)
+ {
+	 sandbox_result tmp;
+	 struct epoll_event ev;
+	 
+	 if (!res)
+		 res = &tmp;
+	 while (!sandbox_poll(h, res))
+		 epoll_wait(h->p.epfd, &ev, 1, -1);
+	 return res->verdict;
+ }
+ 
+ void sandbox_free(sandbox_handle *h)
+ {
+	 if (!h)
+		 return;
+	 if (!h->done)
+	 {
+		 kill(-h->p.pid, SIGKILL);
+		 wait4(h->p.pid, &h->p.status, 0, NULL);  // Collect zombie process
+	 }
+	 sb_close(&h->p);
+	 free(h);
+ }
+ 
+ /*
+  * MICRO-BENCHMARK (sandbox_measure):
+  * - For a function already known to be nice: one sandboxed child,
+  *   pinned to a single CPU with sched_setaffinity (stats->cpu, or the
+  *   CPU it starts on if < 0), calls f() warmup times, then times
+  *   iterations calls one by one with CLOCK_MONOTONIC (the ~20 ns of
+  *   clock_gettime() are included)
+  * - Samples go to a MAP_SHARED array, so if f() crashes or times out
+  *   halfway the verdict says so and the stats cover the calls that
+  *   did complete (done)
+  * - hist[k] counts calls that took [2^k, 2^(k+1)) ns
+  * - The child learns its parameters through a thread-local set right
+  *   before sb_spawn(): fork() copies the calling thread, so concurrent
+  *   sandbox_measure() calls do not see each other's
+  */
+ #define SB_HIST_BUCKETS 40
+ 
+ typedef struct sandbox_stats {
+	 int warmup;          // In: untimed calls first
+	 int iterations;      // In: timed calls
+	 int cpu;             // In: CPU to pin to, < 0: the one it starts on
+	 int done;            // Timed calls that returned
+	 long long min_ns;
+	 long long median_ns;
+	 long long p99_ns;
+	 long long max_ns;
+	 double mean_ns;
+	 long hist[SB_HIST_BUCKETS];
+ } sandbox_stats;
+ 
+ typedef struct sb_samples {
+	 void (*f)(void);
+	 int warmup;
+	 int iterations;
+	 int cpu;
+	 volatile int done;
+	 long long ns[];
+ } sb_samples;
+ 
+ static _Thread_local sb_samples *sb_measuring;
+ 
+ static void sb_measure_body(void)
+ {
+	 sb_samples *s = sb_measuring;
+	 cpu_set_t set;
+	 long long t0;
+	 long long t1;
+	 int cpu;
+	 
+	 cpu = s->cpu >= 0 ? s->cpu : sched_getcpu();
+	 CPU_ZERO(&set);
+	 if (cpu >= 0)
+	 {
+		 CPU_SET(cpu, &set);
+		 sched_setaffinity(0, sizeof(set), &set);
+	 }
+	 for (int i = 0; i < s->warmup; i++)
+		 s->f();
+	 for (int i = 0; i < s->iterations; i++)
+	 {
+		 t0 = sb_now_ns();
+		 s->f();
+		 t1 = sb_now_ns();
+		 s->ns[i] = t1 - t0;
+		 s->done = i + 1;
+	 }
+ }
+ 
+ static void sb_stats(sandbox_stats *stats, long long *ns, int n)
+ {
+	 double sum = 0;
+	 long p99;
+	 int k;
+	 
+	 stats->done = n;
+	 if (!n)
+		 return;
+	 qsort(ns, n, sizeof(*ns), sb_ll_cmp);
+	 stats->min_ns = ns[0];
+	 stats->median_ns = ns[n / 2];
+	 p99 = ((long)n * 99 + 99) / 100 - 1;  // Nearest rank: ceil(0.99 n)-th sample
+	 stats->p99_ns = ns[p99 > 0 ? p99 : 0];
+	 stats->max_ns = ns[n - 1];
+	 for (int i = 0; i < n; i++)
+	 {
+		 sum += ns[i];
+		 for (k = 0; k < SB_HIST_BUCKETS - 1 && ns[i] >> (k + 1); k++)
+			 ;
+		 stats->hist[k]++;
+	 }
+	 stats->mean_ns = sum / n;
+ }
+ 
+ /*
+  * Returns the verdict, as sandbox_run(); stats is filled either way.
+  * opts->timeout_ns covers the whole measurement.
+  */
+ int sandbox_measure(void (*f)(void), const sandbox_opts *opts, sandbox_stats *stats,
+	 sandbox_result *res)
+ {
+	 static const sandbox_opts defaults;
+	 sandbox_result tmp;
+	 sb_samples *s;
+	 size_t size;
+	 sb_proc p;
+	 
+	 if (!opts)
+		 opts = &defaults;
+	 if (!res)
+		 res = &tmp;
+	 memset(res, 0, sizeof(*res));
+	 res->verdict = -1;
+	 res->reason = SB_ERROR;
+	 stats->done = 0;
+	 stats->min_ns = stats->median_ns = stats->p99_ns = stats->max_ns = 0;
+	 stats->mean_ns = 0;
+	 memset(stats->hist, 0, sizeof(stats->hist));
+	 if (stats->warmup < 0 || stats->iterations < 0)
+		 return -1;
+	 size = sizeof(*s) + stats->iterations * sizeof(s->ns[0]);
+	 s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	 if (s == MAP_FAILED)
+		 return -1;
+	 s->f = f;
+	 s->warmup = stats->warmup;
+	 s->iterations = stats->iterations;
+	 s->cpu = stats->cpu;
+	 s->done = 0;
+	 sb_measuring = s;
+	 if (sb_spawn(&p, sb_measure_body, opts) == -1)
+	 {
+		 munmap(s, size);
+		 return -1;
+	 }
+	 sb_wait(&p);
+	 sb_result(&p, opts->verbose, res);
+	 sb_stats(stats, s->ns, s->done);
+	 munmap(s, size);
+	 return res->verdict;
+ }
+ 
+ /*
+  * FORK SERVER:
+  * - fork() copies the caller's page tables, so in a big harness the
+  *   fork itself dominates the cost of a quick f()
+  * - sandbox_server_start() forks a helper once, early, while the
+  *   process is still small; every sandbox_server_run() then asks it
+  *   over a SOCK_SEQPACKET socketpair to run f() with sandbox_run()
+  *   and send the sandbox_result back: same verdicts, cheap forks
+  * - f must already be mapped when the server starts (functions of the
+  *   program or of libraries loaded before): the server is a fork of
+  *   the caller, so the pointer is valid in both
+  * - One request at a time per server: give each thread its own
+  * - No output capture (opts->out / opts->err) and no result channel
+  *   (opts->channel, a mapping the server does not share): the run
+  *   fails with EINVAL
+  * - The server exits when its socket is closed (sandbox_server_stop()
+  *   or death of the caller)
+  */
+ typedef struct sandbox_server {
+	 pid_t pid;
+	 int sock;
+ } sandbox_server;
+ 
+ typedef struct sb_request {
+	 void (*f)(void);
+	 long long timeout_ns;
+	 sandbox_limits limits;
+	 bool no_stop_poll;
+ } sb_request;
+ 
+ static void sb_server_loop(int sock)
+ {
+	 sandbox_opts opts;
+	 sandbox_result res;
+	 sb_request req;
+	 
+	 memset(&opts, 0, sizeof(opts));
+	 /*
+	  * Our own slots before the handlers: until then owner is the
+	  * caller's pid and sb_child_note one of its slots, so a crash of
+	  * the server itself would land in the caller's record. Single
+	  * threaded now, so a lock held by another caller thread at fork()
+	  * can be dropped
+	  */
+	 sb_child_note = NULL;
+	 sb_child_gen = 0;
+	 __atomic_clear(&sb_pool.lock, __ATOMIC_RELEASE);
+	 sb_pool_init(getpid());
+	 sb_install_handlers(true, false);
+	 sb_handlers_inherited = true;
+	 while (recv(sock, &req, sizeof(req), 0) == sizeof(req))
+	 {
+		 opts.timeout_ns = req.timeout_ns;
+		 opts.limits = req.limits;
+		 opts.no_stop_poll = req.no_stop_poll;
+		 sandbox_run(req.f, &opts, &res);
+		 if (send(sock, &res, sizeof(res), MSG_NOSIGNAL) != sizeof(res))
+			 break;
+	 }
+	 _exit(0);
+ }
+ 
+ int sandbox_server_start(sandbox_server *srv)
+ {
+	 int sv[2];
+	 
+	 if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+		 return -1;
+	 fflush(NULL);
+	 srv->pid = fork();
+	 if (srv->pid == -1)
+	 {
+		 close(sv[0]);
+		 close(sv[1]);
+		 return -1;
+	 }
+	 if (srv->pid == 0)
+	 {
+		 close(sv[0]);
+		 sb_server_loop(sv[1]);
+	 }
+	 close(sv[1]);
+	 srv->sock = sv[0];
+	 return 0;
+ }
+ 
+ int sandbox_server_run(sandbox_server *srv, void (*f)(void), const sandbox_opts *opts,
+	 sandbox_result *res)
+ {
+	 sb_request req;
+	 sandbox_result tmp;
+	 
+	 if (!res)
+		 res = &tmp;
+	 memset(res, 0, sizeof(*res));
+	 res->verdict = -1;
+	 res->reason = SB_ERROR;
+	 memset(&req, 0, sizeof(req));
+	 if (opts && (opts->out || opts->err || opts->channel))
+	 {
+		 errno = EINVAL;
+		 return -1;
+	 }
+	 req.f = f;
+	 if (opts)
+	 {
+		 req.timeout_ns = opts->timeout_ns;
+		 req.limits = opts->limits;
+		 req.no_stop_poll = opts->no_stop_poll;
+	 }
+	 if (send(srv->sock, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req)
+		 || recv(srv->sock, res, sizeof(*res), 0) != sizeof(*res))
+		 return -1;
+	 if (opts && opts->verbose)
+		 sb_print(res, opts->timeout_ns);
+	 return res->verdict;
+ }
+ 
+ void sandbox_server_stop(sandbox_server *srv)
+ {
+	 close(srv->sock);
+	 waitpid(srv->pid, NULL, 0);
+ }
+ 
+ #ifdef SANDBOX_BENCH
+ /*
+  * BENCHMARKS (compile with -DSANDBOX_BENCH -O2):
+  *   cc -DSANDBOX_BENCH -O2 sandbox.c -o sandbox_bench
+  *   ./sandbox_bench               correctness gate only
+  *   ./sandbox_bench many [n]      sandbox_many at several parallelisms
+  *   ./sandbox_bench async [n]     n sandboxes in flight on one thread
+  *   ./sandbox_bench forkserver [n]  sandboxes/s with and without the
+  *                                   fork server, parent RSS 0-1 GB
+  *   ./sandbox_bench limits [n]    nice f() with and without limits
+  *   ./sandbox_bench measure [n]   sandbox_measure of a few functions
+  *   ./sandbox_bench channel [mb]  an mb-MB result through a stdout
+  *                                 capture and through a result channel
+  * - The gate runs the example functions below through every entry
+  *   point and checks the verdicts before anything is measured
+  */
+ static void ex_nice(void)
+ {
+ }
+ 
+ static void ex_exit_code(void)
+ {
+	 exit(1);
+ }
+ 
+ static void ex_segfault(void)
+ {
+	 volatile int *ptr = NULL;
+	 
+	 *ptr = 42;
+ }
+ 
+ static void ex_timeout(void)
+ {
+	 for (;;)
+		 ;
+ }
+ 
+ static void ex_abort(void)
+ {
+	 abort();
+ }
+ 
+ static void ex_alloc_64mb(void)
+ {
+	 volatile char *p = malloc(64 << 20);
+	 
+	 for (int i = 0; p && i < 64 << 20; i += 4096)
+		 p[i] = 1;  // Touch every page
+	 free((void *)p);
+ }
+ 
+ static void ex_alloc_50gb(void)
+ {
+	 volatile char *p = malloc(50LL << 30);
+	 
+	 for (long long i = 0; i < 50LL << 30; i += 4096)
+		 p[i] = 1;  // NULL under the limit: SIGSEGV
+	 free((void *)p);
+ }
+ 
+ static void ex_fd_leak(void)
+ {
+	 for (;;)
+		 if (dup(1) == -1)
+			 exit(1);
+ }
+ 
+ // Runs into EMFILE, closes it all again, exits 1 with errno still EMFILE
+ static void ex_fd_recovered(void)
+ {
+	 int first = dup(1);
+	 int last = first;
+	 int fd;
+	 
+	 while ((fd = dup(1)) != -1)
+		 last = fd;
+	 for (fd = first; first != -1 && fd <= last; fd++)
+		 close(fd);
+	 exit(1);
+ }
+ 
+ static pid_t *ex_orphan_pid;  // Shared mapping: f() only keeps fds 0-2
+ 
+ // Leaves a spinning grandchild behind and reports its pid
+ static void ex_orphan(void)
+ {
+	 pid_t pid = fork();
+	 
+	 if (pid == 0)
+		 for (;;)
+			 ;
+	 *ex_orphan_pid = pid;
+ }
+ 
+ static void ex_orphan_then_spin(void)
+ {
+	 ex_orphan();
+	 ex_timeout();
+ }
+ 
+ // 1 MB of 'a'..'z' on stdout, in pieces, then a line on stderr
+ static void ex_chatty(void)
+ {
+	 char chunk[1000];
+	 long i = 0;
+	 
+	 while (i < 1 << 20)
+	 {
+		 int n = (1 << 20) - i < 1000 ? (1 << 20) - i : 1000;
+		 
+		 for (int k = 0; k < n; k++)
+			 chunk[k] = 'a' + (i + k) % 26;
+		 write(STDOUT_FILENO, chunk, n);
+		 i += n;
+	 }
+	 fprintf(stderr, "done\n");
+ }
+ 
+ // Nice for 499 calls, then a segfault
+ static void ex_crash_at_500(void)
+ {
+	 static int calls;
+	 
+	 if (++calls == 500)
+		 ex_segfault();
+ }
+ 
+ static void ex_sum_1k(void)
+ {
+	 static volatile int sink;
+	 
+	 for (int i = 0; i < 1000; i++)
+		 sink += i;
+ }
+ 
+ static void ex_sigstop(void)
+ {
+	 raise(SIGSTOP);
+ }
+ 
+ static void ex_sigtstp(void)
+ {
+	 raise(SIGTSTP);
+ }
+ 
+ static void ex_div_zero(void)
+ {
+	 volatile int zero = 0;
+	 volatile int x = 42;
+	 
+	 x = x / zero;  // Not 1 / zero: GCC turns that into a compare
+ }
+ 
+ static int ex_recurse(volatile char *prev)
+ {
+	 volatile char frame[1024];
+	 
+	 frame[0] = prev ? prev[0] + 1 : 0;
+	 if (frame[0] == 42 && prev == frame)  // Never: hides the recursion from -Wall
+		 return 0;
+	 return ex_recurse(frame) + frame[1];
+ }
+ 
+ static void ex_stack_overflow(void)
+ {
+	 ex_recurse(NULL);
+ }
+ 
+ static void ex_sleep_2ms(void)
+ {
+	 struct timespec ts = {0, 2000000};
+	 
+	 nanosleep(&ts, NULL);
+ }
+ 
+ // Returns the squares of 0..999 as ints
+ static void ex_channel_squares(void)
+ {
+	 int *sq = sandbox_channel_buf(NULL);
+	 
+	 for (int i = 0; i < 1000; i++)
+		 sq[i] = i * i;
+	 sandbox_channel_commit(1000 * sizeof(int));
+ }
+ 
+ static void ex_channel_then_crash(void)
+ {
+	 ex_channel_squares();
+	 ex_segfault();
+ }
+ 
+ // Nice, but its commit of cap + 1 bytes must be refused
+ static void ex_channel_too_big(void)
+ {
+	 size_t cap;
+	 
+	 sandbox_channel_buf(&cap);
+	 if (sandbox_channel_commit(cap + 1) != -1)
+		 exit(1);
+ }
+ 
+ static size_t bench_result_bytes = 1 << 20;
+ 
+ static void ex_result_stdout(void)
+ {
+	 static char chunk[1 << 16];
+	 size_t left = bench_result_bytes;
+	 ssize_t w;
+	 
+	 memset(chunk, 'r', sizeof(chunk));
+	 while (left > 0)
+	 {
+		 w = write(STDOUT_FILENO, chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+		 if (w <= 0)
+			 exit(1);
+		 left -= w;
+	 }
+ }
+ 
+ static void ex_result_channel(void)
+ {
+	 memset(sandbox_channel_buf(NULL), 'r', bench_result_bytes);
+	 sandbox_channel_commit(bench_result_bytes);
+ }
+ 
+ static const struct {
+	 const char *name;
+	 void (*f)(void);
+	 int expected;
+ } gate_cases[] = {
+	 {"nice", ex_nice, 1},
+	 {"exit code", ex_exit_code, 0},
+	 {"segfault", ex_segfault, 0},
+	 {"timeout", ex_timeout, 0},
+	 {"abort", ex_abort, 0},
+	 {"SIGSTOP", ex_sigstop, 0},
+	 {"SIGTSTP", ex_sigtstp, 0},
+ };
+ 
+ #define GATE_N ((int)(sizeof(gate_cases) / sizeof(gate_cases[0])))
+ 
+ static long long bench_now_ns(void)
+ {
+	 struct timespec ts;
+	 
+	 clock_gettime(CLOCK_MONOTONIC, &ts);
+	 return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+ }
+ 
+ static int gate_server(void)
+ {
+	 sandbox_opts opts = {.timeout_ns = 1000000000LL};
+	 sandbox_server srv;
+	 int fail = 0;
+	 int r;
+	 int i;
+	 
+	 if (sandbox_server_start(&srv) == -1)
+		 return 1;
+	 for (i = 0; i < GATE_N; i++)
+	 {
+		 r = sandbox_server_run(&srv, gate_cases[i].f, &opts, NULL);
+		 if (r != gate_cases[i].expected)
+		 {
+			 printf("FAIL sandbox_server_run %s: %d\n", gate_cases[i].name, r);
+			 fail = 1;
+		 }
+	 }
+	 sandbox_server_stop(&srv);
+	 return fail;
+ }
+ 
+ /*
+  * RESOURCE USAGE:
+  * - A spinning function must show CPU time close to its 50 ms budget,
+  *   a function touching 64 MB a peak RSS and minor faults to match
+  */
+ static int gate_rusage(void)
+ {
+	 sandbox_opts opts = {.timeout_ns = 50000000LL};
+	 sandbox_result res;
+	 int fail = 0;
+	 
+	 sandbox_run(ex_timeout, &opts, &res);
+	 printf("spin 50 ms: user %lld us, sys %lld us, nvcsw %ld, nivcsw %ld\n",
+		 res.utime_ns / 1000, res.stime_ns / 1000, res.nvcsw, res.nivcsw);
+	 if (res.utime_ns + res.stime_ns < 25000000LL)
+		 fail = 1;
+	 opts.timeout_ns = 0;
+	 sandbox_run(ex_alloc_64mb, &opts, &res);
+	 printf("alloc 64 MB: maxrss %ld kB, minflt %ld, majflt %ld\n",
+		 res.maxrss_kb, res.minflt, res.majflt);
+	 if (res.verdict != 1 || res.maxrss_kb < 64 * 1024 || res.minflt < 64 * 1024 / 4)
+		 fail = 1;
+	 return fail;
+ }
+ 
+ /*
+  * LIMITS:
+  * - Each limit has a function that hits it and must get its own
+  *   verdict; the nice function must stay nice under all of them
+  * - A limit hit f() got past is not the reason it exited
+  */
+ static int gate_limits(void)
+ {
+	 static const struct {
+		 const char *name;
+		 void (*f)(void);
+		 sandbox_limits limits;
+		 int reason;
+	 } cases[] = {
+		 {"50 GB under 256 MB", ex_alloc_50gb, {.mem_bytes = 256LL << 20}, SB_MEM_LIMIT},
+		 {"64 MB under 256 MB", ex_alloc_64mb, {.mem_bytes = 256LL << 20}, SB_NICE},
+		 {"spin under 1 s CPU", ex_timeout, {.cpu_seconds = 1}, SB_CPU_LIMIT},
+		 {"fd leak under 64 files", ex_fd_leak, {.max_files = 64}, SB_FILE_LIMIT},
+		 {"fds freed, then exit 1", ex_fd_recovered, {.max_files = 64}, SB_EXITED},
+		 {"abort without core", ex_abort, {.no_core = true}, SB_SIGNALED},
+		 {"nice under all", ex_nice, {256LL << 20, 1, 64, true}, SB_NICE},
+	 };
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL};
+	 sandbox_result res;
+	 int fail = 0;
+	 
+	 for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+	 {
+		 opts.limits = cases[i].limits;
+		 sandbox_run(cases[i].f, &opts, &res);
+		 if (res.reason != cases[i].reason)
+		 {
+			 printf("FAIL limits %s: reason %d\n", cases[i].name, res.reason);
+			 fail = 1;
+		 }
+	 }
+	 return fail;
+ }
+ 
+ /*
+  * PROCESS TREE:
+  * - f() forks a spinning grandchild, then either returns or times out;
+  *   once sandbox_run() is back the grandchild must be dead (gone, or a
+  *   zombie left to init) within 100 ms: SIGKILL is sent to the group
+  *   before sandbox_run() returns, but a process that is not our child
+  *   cannot be waited for
+  */
+ static bool gate_alive(pid_t pid)
+ {
+	 char path[64];
+	 char buf[256];
+	 char *state;
+	 FILE *fp;
+	 
+	 snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	 fp = fopen(path, "r");
+	 if (!fp)
+		 return false;
+	 state = fgets(buf, sizeof(buf), fp) ? strrchr(buf, ')') : NULL;
+	 fclose(fp);
+	 return state && state[2] != 'Z' && state[2] != 'X';
+ }
+ 
+ static int gate_tree(void)
+ {
+	 static void (*const fns[])(void) = {ex_orphan, ex_orphan_then_spin};
+	 sandbox_opts opts = {.timeout_ns = 20000000LL};
+	 struct timespec ms = {0, 1000000};
+	 pid_t grandchild;
+	 int fail = 0;
+	 int tries;
+	 
+	 ex_orphan_pid = mmap(NULL, sizeof(*ex_orphan_pid), PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	 if (ex_orphan_pid == MAP_FAILED)
+		 return 1;
+	 for (int i = 0; i < 2; i++)
+	 {
+		 *ex_orphan_pid = 0;
+		 sandbox_run(fns[i], &opts, NULL);
+		 grandchild = *ex_orphan_pid > 0 ? *ex_orphan_pid : getpid();  // getpid(): FAIL
+		 for (tries = 0; tries < 100 && gate_alive(grandchild); tries++)
+			 nanosleep(&ms, NULL);
+		 if (tries == 100)
+		 {
+			 printf("FAIL tree: grandchild of %s survived\n", i ? "timeout" : "nice");
+			 fail = 1;
+		 }
+	 }
+	 munmap(ex_orphan_pid, sizeof(*ex_orphan_pid));
+	 return fail;
+ }
+ 
+ /*
+  * OUTPUT CAPTURE:
+  * - 1 MB through a 4 kB stdout ring (far more than a pipe holds, so
+  *   this would deadlock without concurrent draining): must be nice,
+  *   truncated, and hold exactly the last 4096 bytes in order
+  * - stderr fits and comes back whole
+  */
+ static int gate_capture(void)
+ {
+	 static char out_buf[4096];
+	 static char err_buf[64];
+	 sandbox_output out = {out_buf, sizeof(out_buf), 0, 0, false};
+	 sandbox_output err = {err_buf, sizeof(err_buf), 0, 0, false};
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL, .out = &out, .err = &err};
+	 int fail = 0;
+	 
+	 if (sandbox_run(ex_chatty, &opts, NULL) != 1)
+		 fail = 1;
+	 if (!out.truncated || out.total != 1 << 20 || out.len != sizeof(out_buf))
+		 fail = 1;
+	 for (size_t k = 0; k < out.len && !fail; k++)
+		 if (out_buf[k] != (char)('a' + ((1 << 20) - out.len + k) % 26))
+			 fail = 1;
+	 if (err.truncated || err.len != 5 || memcmp(err_buf, "done\n", 5))
+		 fail = 1;
+	 if (fail)
+		 printf("FAIL capture: out %zu/%zu%s, err %zu\n", out.len, out.total,
+			 out.truncated ? " truncated" : "", err.len);
+	 return fail;
+ }
+ 
+ /*
+  * MEASURE:
+  * - 1000 timed calls of a nice f(): all done, ordered stats, the
+  *   histogram adds up
+  * - A crash on call 500 (100 of them warmup): verdict bad, and the
+  *   stats cover exactly the 399 timed calls before it
+  */
+ static int gate_measure(void)
+ {
+	 sandbox_stats st = {.warmup = 100, .iterations = 1000, .cpu = -1};
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL};
+	 sandbox_result res;
+	 long sum = 0;
+	 int fail = 0;
+	 
+	 if (sandbox_measure(ex_sum_1k, &opts, &st, &res) != 1 || st.done != 1000
+		 || st.min_ns > st.median_ns || st.median_ns > st.p99_ns
+		 || st.p99_ns > st.max_ns)
+		 fail = 1;
+	 for (int k = 0; k < SB_HIST_BUCKETS; k++)
+		 sum += st.hist[k];
+	 if (sum != 1000)
+		 fail = 1;
+	 if (sandbox_measure(ex_crash_at_500, &opts, &st, &res) != 0
+		 || res.reason != SB_SIGNALED || st.done != 399)
+	 {
+		 printf("FAIL measure: crash mid-run gave verdict %d, done %d\n", res.verdict,
+			 st.done);
+		 fail = 1;
+	 }
+	 return fail;
+ }
+ 
+ /*
+  * STOPPED CHILDREN:
+  * - SIGSTOP and SIGTSTP under a 5 s budget: SB_STOPPED with the stop
+  *   signal, and well before the deadline (the gate cases above cover
+  *   the verdict of every entry point)
+  * - That is the default: a plain sandbox_run() with no timeout must
+  *   not hang on a stopped child
+  * - With opts->no_stop_poll nothing polls for it: a SIGSTOP is only
+  *   noticed at the deadline, as SB_TIMEOUT
+  */
+ static int gate_stopped(void)
+ {
+	 static void (*const fns[])(void) = {ex_sigstop, ex_sigtstp};
+	 static const int sigs[] = {SIGSTOP, SIGTSTP};
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL};
+	 sandbox_result res;
+	 int fail = 0;
+	 
+	 sandbox_run(ex_sigstop, NULL, &res);
+	 if (res.reason != SB_STOPPED)
+	 {
+		 printf("FAIL stopped, default opts: reason %d\n", res.reason);
+		 fail = 1;
+	 }
+	 for (int i = 0; i < 2; i++)
+	 {
+		 sandbox_run(fns[i], &opts, &res);
+		 if (res.reason != SB_STOPPED || res.code != sigs[i]
+			 || res.runtime_ns > 200000000LL)
+		 {
+			 printf("FAIL stopped %s: reason %d, %lld ms\n", strsignal(sigs[i]), res.reason,
+				 res.runtime_ns / 1000000);
+			 fail = 1;
+		 }
+	 }
+	 opts.no_stop_poll = true;
+	 opts.timeout_ns = 50000000LL;
+	 sandbox_run(ex_sigstop, &opts, &res);
+	 if (res.reason != SB_TIMEOUT)
+	 {
+		 printf("FAIL stopped, no_stop_poll: reason %d\n", res.reason);
+		 fail = 1;
+	 }
+	 return fail;
+ }
+ 
+ /*
+  * ASYNC:
+  * - Every gate case started at once and supervised from one epoll
+  *   loop over their sandbox_fd(); then a started spinner is freed
+  *   without waiting and must leave nothing behind
+  */
+ static int gate_async(void)
+ {
+	 sandbox_opts opts = {.timeout_ns = 1000000000LL};
+	 sandbox_handle *h[GATE_N];
+	 struct epoll_event ev[GATE_N];
+	 sandbox_result res;
+	 int left = 0;
+	 int fail = 0;
+	 int loop;
+	 int n;
+	 
+	 loop = epoll_create1(EPOLL_CLOEXEC);
+	 if (loop == -1)
+		 return 1;
+	 for (int i = 0; i < GATE_N; i++)
+	 {
+		 h[i] = sandbox_start(gate_cases[i].f, &opts);
+		 if (!h[i])
+			 return 1;
+		 ev[0].events = EPOLLIN;
+		 ev[0].data.u32 = i;
+		 epoll_ctl(loop, EPOLL_CTL_ADD, sandbox_fd(h[i]), &ev[0]);
+		 left++;
+	 }
+	 while (left > 0)
+	 {
+		 n = epoll_wait(loop, ev, GATE_N, -1);
+		 for (int k = 0; k < n; k++)
+		 {
+			 int i = ev[k].data.u32;
+			 
+			 if (!sandbox_poll(h[i], &res))
+				 continue;
+			 epoll_ctl(loop, EPOLL_CTL_DEL, sandbox_fd(h[i]), NULL);
+			 if (res.verdict != gate_cases[i].expected)
+			 {
+				 printf("FAIL async %s: %d\n", gate_cases[i].name, res.verdict);
+				 fail = 1;
+			 }
+			 left--;
+		 }
+	 }
+	 for (int i = 0; i < GATE_N; i++)
+		 sandbox_free(h[i]);
+	 close(loop);
+	 h[0] = sandbox_start(ex_timeout, NULL);
+	 n = h[0] ? sandbox_pid(h[0]) : 0;
+	 sandbox_free(h[0]);
+	 if (!n || waitpid(n, NULL, WNOHANG) != -1 || errno != ECHILD)
+	 {
+		 printf("FAIL async: freeing a running sandbox leaked its child\n");
+		 fail = 1;
+	 }
+	 return fail;
+ }
+ 
+ /*
+  * CRASH RECORDS:
+  * - NULL store, integer division by zero and stack overflow (the
+  *   handler must still run, on its own stack): signal, si_code and
+  *   address as expected, pc inside the crashing function, and the
+  *   backtrace starting at the pc
+  * - abort() and a nice f() leave no record
+  * - Not asked for: no record; through the fork server: a record anyway
+  */
+ static int gate_crash(void)
+ {
+	 static const struct {
+		 const char *name;
+		 void (*f)(void);
+		 void *fn;      // Function the pc must be in
+		 int signo;
+		 int code;      // -1: any
+	 } cases[] = {
+		 {"NULL store", ex_segfault, (void *)ex_segfault, SIGSEGV, SEGV_MAPERR},
+		 {"div by zero", ex_div_zero, (void *)ex_div_zero, SIGFPE, FPE_INTDIV},
+		 {"stack overflow", ex_stack_overflow, (void *)ex_recurse, SIGSEGV, -1},
+		 {"abort", ex_abort, NULL, 0, 0},
+		 {"nice", ex_nice, NULL, 0, 0},
+	 };
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL, .crash = true};
+	 sandbox_result res;
+	 sandbox_crash *c = &res.crash;
+	 sandbox_server srv;
+	 int fail = 0;
+	 
+	 for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+	 {
+		 sandbox_run(cases[i].f, &opts, &res);
+		 if (c->signo != cases[i].signo
+			 || (cases[i].signo && cases[i].code != -1 && c->code != cases[i].code)
+			 || (cases[i].f == ex_segfault && c->addr != NULL)
+			 || (cases[i].fn && ((char *)c->pc < (char *)cases[i].fn
+				 || (char *)c->pc >= (char *)cases[i].fn + 256))
+			 || (cases[i].fn && (c->depth < 1 || c->trace[0] != c->pc)))
+		 {
+			 printf("FAIL crash %s: signo %d code %d addr %p pc %p (fn %p) depth %d trace[0] %p\n",
+				 cases[i].name, c->signo, c->code, c->addr, c->pc, cases[i].fn, c->depth,
+				 c->depth ? c->trace[0] : NULL);
+			 fail = 1;
+		 }
+	 }
+	 opts.crash = false;
+	 sandbox_run(ex_segfault, &opts, &res);
+	 if (c->signo)
+	 {
+		 printf("FAIL crash: recorded without opts.crash\n");
+		 fail = 1;
+	 }
+	 if (sandbox_server_start(&srv) == 0)
+	 {
+		 sandbox_server_run(&srv, ex_segfault, &opts, &res);
+		 if (c->signo != SIGSEGV || c->code != SEGV_MAPERR)
+		 {
+			 printf("FAIL crash: no record through the fork server\n");
+			 fail = 1;
+		 }
+		 sandbox_server_stop(&srv);
+	 }
+	 return fail;
+ }
+ 
+ /*
+  * RESULT CHANNEL:
+  * - A nice f() returns 1000 squares: data points into the mapping
+  *   (no copy) and holds them all
+  * - Same writes and commit, then a crash: data NULL
+  * - No commit, and a commit past cap (refused): data NULL, still nice
+  * - Twice in a row on the same channel, and not through the fork
+  *   server (EINVAL)
+  */
+ static int gate_channel(void)
+ {
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL};
+	 sandbox_server srv;
+	 sandbox_channel ch;
+	 const int *sq;
+	 int fail = 0;
+	 
+	 if (sandbox_channel_open(&ch, 1 << 16) == -1)
+		 return 1;
+	 opts.channel = &ch;
+	 for (int round = 0; round < 2; round++)
+	 {
+		 if (sandbox_run(ex_channel_squares, &opts, NULL) != 1 || ch.len != 1000 * sizeof(int)
+			 || (sq = ch.data) != (const int *)((char *)ch.map + SB_CHAN_DATA))
+			 fail = 1;
+		 for (int i = 0; i < 1000 && !fail; i++)
+			 if (sq[i] != i * i)
+				 fail = 1;
+	 }
+	 if (sandbox_run(ex_channel_then_crash, &opts, NULL) != 0 || ch.data || ch.len)
+		 fail = 1;
+	 if (sandbox_run(ex_nice, &opts, NULL) != 1 || ch.data || ch.len)
+		 fail = 1;
+	 if (sandbox_run(ex_channel_too_big, &opts, NULL) != 1 || ch.data || ch.len)
+		 fail = 1;
+	 if (sandbox_channel_buf(NULL) || sandbox_channel_commit(0) != -1)
+		 fail = 1;  // Not inside f()
+	 if (sandbox_server_start(&srv) == 0)
+	 {
+		 if (sandbox_server_run(&srv, ex_channel_squares, &opts, NULL) != -1 || errno != EINVAL)
+			 fail = 1;
+		 sandbox_server_stop(&srv);
+	 }
+	 if (fail)
+		 printf("FAIL channel: data %p len %zu\n", ch.data, ch.len);
+	 sandbox_channel_close(&ch);
+	 return fail;
+ }
+ 
+ /*
+  * TIMEOUT OVERSHOOT:
+  * - A spinning function under 5 ms and 50 ms budgets; overshoot is the
+  *   measured runtime minus the budget (deadline to SIGKILL)
+  * - Fails if the 95th percentile is more than 1 ms late (the single
+  *   worst run is reported too, but a loaded machine can always lose
+  *   a few ms to the scheduler)
+  */
+ static int gate_overshoot(void)
+ {
+	 static const long long budgets[] = {5000000LL, 50000000LL};
+	 long long over[20];
+	 sandbox_opts opts = {.timeout_ns = 0};
+	 sandbox_result res;
+	 int fail = 0;
+	 int i;
+	 int k;
+	 
+	 for (k = 0; k < 2; k++)
+	 {
+		 opts.timeout_ns = budgets[k];
+		 for (i = 0; i < 20; i++)
+		 {
+			 sandbox_run(ex_timeout, &opts, &res);
+			 if (res.reason != SB_TIMEOUT)
+				 fail = 1;
+			 over[i] = res.runtime_ns - budgets[k];
+		 }
+		 qsort(over, 20, sizeof(over[0]), sb_ll_cmp);
+		 printf("timeout %2lld ms: overshoot min %lld us, median %lld us, p95 %lld us, max %lld us\n",
+			 budgets[k] / 1000000, over[0] / 1000, over[10] / 1000, over[18] / 1000,
+			 over[19] / 1000);
+		 if (over[0] < 0 || over[18] > 1000000)
+			 fail = 1;
+	 }
+	 return fail;
+ }
+ 
+ static int bench_gate(void)
+ {
+	 void (*fns[GATE_N])(void);
+	 int results[GATE_N];
+	 int fail = 0;
+	 int r;
+	 int i;
+	 
+	 for (i = 0; i < GATE_N; i++)
+	 {
+		 r = sandbox(gate_cases[i].f, 1, false);
+		 if (r != gate_cases[i].expected)
+		 {
+			 printf("FAIL sandbox %s: %d\n", gate_cases[i].name, r);
+			 fail = 1;
+		 }
+		 r = sandbox_mt(gate_cases[i].f, 1, false);
+		 if (r != gate_cases[i].expected)
+		 {
+			 printf("FAIL sandbox_mt %s: %d\n", gate_cases[i].name, r);
+			 fail = 1;
+		 }
+		 fns[i] = gate_cases[i].f;
+	 }
+	 if (sandbox_many(fns, GATE_N, 1, 3, results) != 1)
+		 fail = 1;
+	 for (i = 0; i < GATE_N; i++)
+		 if (results[i] != gate_cases[i].expected)
+		 {
+			 printf("FAIL sandbox_many %s: %d\n", gate_cases[i].name, results[i]);
+			 fail = 1;
+		 }
+	 fail |= gate_server();
+	 fail |= gate_rusage();
+	 fail |= gate_limits();
+	 fail |= gate_tree();
+	 fail |= gate_capture();
+	 fail |= gate_measure();
+	 fail |= gate_stopped();
+	 fail |= gate_async();
+	 fail |= gate_crash();
+	 fail |= gate_channel();
+	 fail |= gate_overshoot();
+	 printf("gate: %s\n", fail ? "FAIL" : "ok");
+	 return fail;
+ }
+ 
+ /*
+  * SANDBOX_MANY THROUGHPUT:
+  * - n functions that sleep 2 ms each, so the ideal time at
+  *   parallelism P is n * 2ms / P plus the fork cost
+  */
+ static int bench_many(int n)
+ {
+	 static const int pars[] = {1, 4, 16, 64};
+	 void (**fns)(void);
+	 int *results;
+	 long long t0;
+	 int nice;
+	 int i;
+	 int k;
+	 
+	 fns = malloc(n * sizeof(*fns));
+	 results = malloc(n * sizeof(*results));
+	 if (!fns || !results)
+		 return 1;
+	 for (i = 0; i < n; i++)
+		 fns[i] = ex_sleep_2ms;
+	 printf("%d functions x 2 ms (sequential ideal %.0f ms)\n", n, n * 2.0);
+	 for (k = 0; k < (int)(sizeof(pars) / sizeof(pars[0])); k++)
+	 {
+		 t0 = bench_now_ns();
+		 nice = sandbox_many(fns, n, 5, pars[k], results);
+		 printf("parallelism %3d: %8.1f ms (ideal %6.1f)  nice %d/%d\n", pars[k],
+			 (bench_now_ns() - t0) / 1e6, n * 2.0 / pars[k], nice, n);
+	 }
+	 free(fns);
+	 free(results);
+	 return 0;
+ }
+ 
+ /*
+  * FORK SERVER VS DIRECT FORK:
+  * - Trivial f(), n runs each way, while the parent holds 0 to 1 GB of
+  *   touched heap (the server was started before any of it)
+  */
+ static int bench_forkserver(int n)
+ {
+	 static const size_t mb[] = {0, 64, 256, 1024};
+	 sandbox_server srv;
+	 char *ballast = NULL;
+	 long long t0;
+	 double direct;
+	 double served;
+	 int i;
+	 int k;
+	 
+	 if (sandbox_server_start(&srv) == -1)
+		 return 1;
+	 printf("%d runs of a trivial f()\n", n);
+	 for (k = 0; k < (int)(sizeof(mb) / sizeof(mb[0])); k++)
+	 {
+		 free(ballast);
+		 ballast = NULL;
+		 if (mb[k])
+		 {
+			 ballast = malloc(mb[k] << 20);
+			 if (!ballast)
+				 break;
+			 memset(ballast, 1, mb[k] << 20);
+		 }
+		 t0 = bench_now_ns();
+		 for (i = 0; i < n; i++)
+			 sandbox_run(ex_nice, NULL, NULL);
+		 direct = n / ((bench_now_ns() - t0) / 1e9);
+		 t0 = bench_now_ns();
+		 for (i = 0; i < n; i++)
+			 sandbox_server_run(&srv, ex_nice, NULL, NULL);
+		 served = n / ((bench_now_ns() - t0) / 1e9);
+		 printf("parent RSS +%4zu MB: direct %8.0f/s   fork server %8.0f/s  (x%.1f)\n",
+			 mb[k], direct, served, served / direct);
+	 }
+	 free(ballast);
+	 sandbox_server_stop(&srv);
+	 return 0;
+ }
+ 
+ /*
+  * COST OF LIMITS:
+  * - A nice f() n times bare, then under every limit (setrlimit x4,
+  *   shared page, handlers); interleaved rounds so drift hits both
+  */
+ static int bench_limits(int n)
+ {
+	 sandbox_opts bare = {.timeout_ns = 0};
+	 sandbox_opts limited = {.limits = {256LL << 20, 1, 64, true}};
+	 long long t_bare = 0;
+	 long long t_limited = 0;
+	 long long t0;
+	 int round;
+	 int i;
+	 
+	 for (round = 0; round < 10; round++)
+	 {
+		 t0 = bench_now_ns();
+		 for (i = 0; i < n / 10; i++)
+			 sandbox_run(ex_nice, &bare, NULL);
+		 t_bare += bench_now_ns() - t0;
+		 t0 = bench_now_ns();
+		 for (i = 0; i < n / 10; i++)
+			 sandbox_run(ex_nice, &limited, NULL);
+		 t_limited += bench_now_ns() - t0;
+	 }
+	 printf("%d runs of a trivial f(): bare %.1f us/run, all limits %.1f us/run\n",
+		 n / 10 * 10, t_bare / 1e3 / (n / 10 * 10), t_limited / 1e3 / (n / 10 * 10));
+	 return 0;
+ }
+ 
+ /*
+  * RESULT SIZE:
+  * - An mb-MB result returned through a stdout capture (pipe, drained
+  *   into an mb-MB ring) and through a result channel, best of 5 each
+  */
+ static int bench_channel(int mb)
+ {
+	 sandbox_opts opts = {.timeout_ns = 0};
+	 sandbox_output out;
+	 sandbox_channel ch;
+	 long long best[2] = {0, 0};
+	 long long t;
+	 bool ok = true;
+	 
+	 bench_result_bytes = (size_t)mb << 20;
+	 out.buf = malloc(bench_result_bytes);
+	 out.cap = bench_result_bytes;
+	 if (!out.buf || sandbox_channel_open(&ch, bench_result_bytes) == -1)
+		 return 1;
+	 for (int round = 0; round < 5; round++)
+	 {
+		 opts.out = &out;
+		 opts.channel = NULL;
+		 t = bench_now_ns();
+		 ok &= sandbox_run(ex_result_stdout, &opts, NULL) == 1 && out.len == bench_result_bytes;
+		 t = bench_now_ns() - t;
+		 best[0] = round && best[0] < t ? best[0] : t;
+		 opts.out = NULL;
+		 opts.channel = &ch;
+		 t = bench_now_ns();
+		 ok &= sandbox_run(ex_result_channel, &opts, NULL) == 1 && ch.len == bench_result_bytes;
+		 t = bench_now_ns() - t;
+		 best[1] = round && best[1] < t ? best[1] : t;
+	 }
+	 printf("%d MB result: stdout capture %.2f ms, result channel %.2f ms%s\n", mb,
+		 best[0] / 1e6, best[1] / 1e6, ok ? "" : " (FAILED)");
+	 free(out.buf);
+	 sandbox_channel_close(&ch);
+	 return !ok;
+ }
+ 
+ /*
+  * MEASURE REPORT:
+  * - sandbox_measure() on an empty f(), a 1000-add loop and a 2 ms
+  *   sleep, n timed calls each, with the non-empty histogram buckets
+  */
+ static int bench_measure(int n)
+ {
+	 static const struct {
+		 const char *name;
+		 void (*f)(void);
+	 } fns[] = {{"empty", ex_nice}, {"sum 1k", ex_sum_1k}, {"sleep 2 ms", ex_sleep_2ms}};
+	 sandbox_stats st;
+	 
+	 for (int i = 0; i < 3; i++)
+	 {
+		 memset(&st, 0, sizeof(st));
+		 st.warmup = n / 10;
+		 st.iterations = i == 2 ? n / 100 + 1 : n;
+		 st.cpu = -1;
+		 sandbox_measure(fns[i].f, NULL, &st, NULL);
+		 printf("%-10s %7d calls: min %lld ns, median %lld ns, p99 %lld ns, max %lld ns\n",
+			 fns[i].name, st.done, st.min_ns, st.median_ns, st.p99_ns, st.max_ns);
+		 for (int k = 0; k < SB_HIST_BUCKETS; k++)
+			 if (st.hist[k])
+				 printf("    [%12lld, %12lld) ns  %ld\n", 1LL << k, 2LL << k, st.hist[k]);
+	 }
+	 return 0;
+ }
+ 
+ /*
+  * ORPHANED PROCESS GROUPS:
+  * - The kernel discards SIGTSTP sent to a process group with no
+  *   parent in another group of the session (typical of CI runners and
+  *   daemons), so there f() just returns and the exam sandbox(), whose
+  *   child stays in our group, rightly says nice
+  * - To test stops the same way everywhere, the bench runs in a child
+  *   that leads its own group: its parent (us) keeps it non-orphaned
+  */
+ static int bench_in_own_group(void)
+ {
+	 int status;
+	 pid_t pid;
+	 
+	 pid = fork();
+	 if (pid == -1)
+		 return -1;
+	 if (pid == 0)
+	 {
+		 setpgid(0, 0);
+		 return 0;
+	 }
+	 setpgid(pid, pid);
+	 if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status))
+		 exit(1);
+	 exit(WEXITSTATUS(status));
+ }
+ 
+ /*
+  * ASYNC THROUGHPUT:
+  * - n functions that sleep 2 ms, all started, then harvested by a
+  *   single epoll loop: ideally n forks plus 2 ms
+  * - Each handle holds about 4 descriptors (see ASYNCHRONOUS SANDBOX),
+  *   so a low RLIMIT_NOFILE stops sandbox_start() early: the line
+  *   reports how many really ran, and fewer than n is a failure
+  */
+ static int bench_async(int n)
+ {
+	 sandbox_opts opts = {.timeout_ns = 5000000000LL};
+	 struct epoll_event ev[64];
+	 sandbox_handle **h;
+	 sandbox_result res;
+	 long long t0;
+	 long long t_started;
+	 int nice = 0;
+	 int started = 0;
+	 int err = 0;
+	 int left;
+	 int loop;
+	 int ready;
+	 
+	 h = calloc(n, sizeof(*h));
+	 loop = epoll_create1(EPOLL_CLOEXEC);
+	 if (!h || loop == -1)
+		 return 1;
+	 t0 = bench_now_ns();
+	 for (int i = 0; i < n; i++)
+	 {
+		 h[i] = sandbox_start(ex_sleep_2ms, &opts);
+		 if (!h[i])
+		 {
+			 err = errno;
+			 break;
+		 }
+		 ev[0].events = EPOLLIN;
+		 ev[0].data.u32 = i;
+		 epoll_ctl(loop, EPOLL_CTL_ADD, sandbox_fd(h[i]), &ev[0]);
+		 started++;
+	 }
+	 t_started = bench_now_ns();
+	 left = started;
+	 while (left > 0)
+	 {
+		 ready = epoll_wait(loop, ev, 64, -1);
+		 for (int k = 0; k < ready; k++)
+		 {
+			 int i = ev[k].data.u32;
+			 
+			 if (!sandbox_poll(h[i], &res))
+				 continue;
+			 epoll_ctl(loop, EPOLL_CTL_DEL, sandbox_fd(h[i]), NULL);
+			 nice += res.verdict == 1;
+			 left--;
+		 }
+	 }
+	 printf("%d/%d x 2 ms on one thread: started in %.1f ms, all done in %.1f ms, nice %d\n",
+		 started, n, (t_started - t0) / 1e6, (bench_now_ns() - t0) / 1e6, nice);
+	 if (started < n)
+		 printf("FAIL async: sandbox_start() failed after %d handles (%s)\n",
+			 started, strerror(err));
+	 for (int i = 0; i < started; i++)
+		 sandbox_free(h[i]);
+	 free(h);
+	 close(loop);
+	 return started < n;
+ }
+ 
+ int main(int argc, char **argv)
+ {
+	 if (bench_in_own_group() == -1)
+		 return 1;
+	 if (bench_gate())
+		 return 1;
+	 if (argc >= 2 && !strcmp(argv[1], "forkserver"))
+		 return bench_forkserver(argc >= 3 ? atoi(argv[2]) : 2000);
+	 if (argc >= 2 && !strcmp(argv[1], "measure"))
+		 return bench_measure(argc >= 3 ? atoi(argv[2]) : 100000);
+	 if (argc >= 2 && !strcmp(argv[1], "limits"))
+		 return bench_limits(argc >= 3 ? atoi(argv[2]) : 2000);
+	 if (argc >= 2 && !strcmp(argv[1], "async"))
+		 return bench_async(argc >= 3 ? atoi(argv[2]) : 200);
+	 if (argc >= 2 && !strcmp(argv[1], "channel"))
+		 return bench_channel(argc >= 3 ? atoi(argv[2]) : 64);
+	 if (argc >= 2 && !strcmp(argv[1], "many"))
+		 return bench_many(argc >= 3 ? atoi(argv[2]) : 2000);
+	 return 0;
+ }
+ #endif
+ 
  /*
   * EXAMPLE FUNCTIONS TO TEST:
   * 
@@ -19,30 +19,187 @@
  * primary     → NUMBER | '(' expression ')'
  */
 
+ #define _GNU_SOURCE
  #include <stdio.h>
  #include <stdlib.h>
  #include <ctype.h>
+ #include <string.h>
+ #include <limits.h>
+ #include <stdint.h>
+ #include <fcntl.h>
+ #include <time.h>
+ #include <unistd.h>
+ #include <dlfcn.h>
+ #include <sys/wait.h>
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #ifdef VBC_BENCH
+ # include <sys/ioctl.h>
+ # include <sys/syscall.h>
+ # include <linux/perf_event.h>
+ # include <pthread.h>
+ #endif
  
  // Definición del AST
  typedef struct node {
 	 enum {
 		 ADD,      // Nodo de suma
 		 MULTI,    // Nodo de multiplicación  
-		 VAL       // Nodo de valor (hoja)
+		 VAL,      // Nodo de valor (hoja)
+		 VAR       // Variable (hoja, solo en modo --grad)
 	 } type;
-	 int val;           // Valor para nodos VAL
+	 int val;           // Valor para nodos VAL, letra (0-25) para VAR
 	 struct node *l;    // Hijo izquierdo
 	 struct node *r;    // Hijo derecho
  } node;
  
+ /*
+  * INSTRUMENTACIÓN (compilar con -DVBC_PROFILE):
+  * - Nodos creados por tipo, reservas y liberaciones, nodos evaluados
+  *   por tipo, profundidad máxima de paréntesis y tiempo por fase
+  *   (parse, eval, destroy) del modo normal
+  * - Tiempo en ciclos con rdtsc en x86-64, en ns con clock_gettime
+  *   en el resto
+  * - Resumen en stderr al salir
+  * - Sin VBC_PROFILE las macros no generan código: coste cero
+  */
+ #ifdef VBC_PROFILE
+ # if defined(__x86_64__) || defined(__i386__)
+ #  include <x86intrin.h>
+ #  define PROF_CLOCK() __rdtsc()
+ #  define PROF_UNIT "cycles"
+ # else
+ #  define PROF_CLOCK() prof_ns()
+ #  define PROF_UNIT "ns"
+ # endif
+ 
+ enum { PH_PARSE, PH_EVAL, PH_DESTROY, PH_COUNT };
+ 
+ typedef struct prof {
+	 long nodes[4];        // Nodos creados por tipo (ADD, MULTI, VAL, VAR)
+	 long evals[4];        // Nodos visitados por eval_tree, por tipo
+	 long allocs;
+	 long frees;
+	 int depth;            // Paréntesis abiertos durante el parse
+	 int max_depth;
+	 unsigned long long phase[PH_COUNT];
+ } prof;
+ 
+ static prof g_prof;
+ 
+ static unsigned long long prof_ns(void)
+ {
+	 struct timespec ts;
+	 
+	 clock_gettime(CLOCK_MONOTONIC, &ts);
+	 return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+ }
+ 
+ static void prof_report(void)
+ {
+	 static const char *phases[] = {"parse", "eval", "destroy"};
+	 int i;
+	 
+	 fflush(stdout);  // El resultado primero, luego el resumen
+	 fprintf(stderr, "-- vbc profile --\n");
+	 fprintf(stderr, "nodes:  ADD %ld  MULTI %ld  VAL %ld  VAR %ld\n",
+		 g_prof.nodes[ADD], g_prof.nodes[MULTI], g_prof.nodes[VAL], g_prof.nodes[VAR]);
+	 fprintf(stderr, "evals:  ADD %ld  MULTI %ld  VAL %ld\n",
+		 g_prof.evals[ADD], g_prof.evals[MULTI], g_prof.evals[VAL]);
+	 fprintf(stderr, "allocs: %ld (%ld bytes)  frees: %ld\n", g_prof.allocs,
+		 g_prof.allocs * (long)sizeof(node), g_prof.frees);
+	 fprintf(stderr, "max paren depth: %d\n", g_prof.max_depth);
+	 for (i = 0; i < PH_COUNT; i++)
+		 fprintf(stderr, "%-8s %llu %s\n", phases[i], g_prof.phase[i], PROF_UNIT);
+	 (void)prof_ns;
+ }
+ 
+ # define PROF(stmt) do { stmt; } while (0)
+ # define PROF_BEGIN(ph) unsigned long long prof_t_##ph = PROF_CLOCK()
+ # define PROF_END(ph) (g_prof.phase[ph] += PROF_CLOCK() - prof_t_##ph)
+ #else
+ # define PROF(stmt) do { } while (0)
+ # define PROF_BEGIN(ph) do { } while (0)
+ # define PROF_END(ph) do { } while (0)
+ #endif
+ 
+ /*
+  * SEMÁNTICA ARITMÉTICA SELECCIONABLE:
+  * - AR_WRAP: enteros de 32 bits que envuelven (lo que hace eval_tree
+  *   en la práctica, pero sin comportamiento indefinido)
+  * - AR_SAT: saturación en INT_MIN / INT_MAX
+  * - AR_MOD: aritmética módulo un primo p < 2^31; los resultados
+  *   siempre están en [0, p)
+  * - Reducción escalar con Barrett: m = floor(2^64 / p) precalculado,
+  *   x mod p = x - floor(x * m / 2^64) * p, más una resta condicional
+  * - Los kernels por lotes usan Montgomery (ver más abajo): solo
+  *   multiplicaciones 32x32→64, que el compilador sí vectoriza
+  */
+ typedef enum arith_mode {
+	 AR_WRAP,
+	 AR_SAT,
+	 AR_MOD
+ } arith_mode;
+ 
+ typedef struct arith {
+	 arith_mode mode;
+	 unsigned p;               // Módulo (solo AR_MOD)
+	 unsigned long long m;     // Barrett: floor(2^64 / p)
+	 unsigned pinv;            // Montgomery: -p^-1 mod 2^32
+	 unsigned r2;              // Montgomery: 2^64 mod p
+ } arith;
+ 
+ static const arith ar_wrap = {AR_WRAP, 0, 0, 0, 0};
+ 
+ /*
+  * CONTEXTO DEL COMPILADOR (vbc_ctx):
+  * - Todo el estado de un parse vive aquí, nada en globales (salvo los
+  *   contadores de -DVBC_PROFILE), así cada hilo usa su propio contexto
+  * - Arena de nodos: bloques encadenados que vbc_reset() reutiliza sin
+  *   liberarlos; un árbol del contexto vive hasta el siguiente reset
+  * - Buffer de error: el primer error del último parse, con su offset
+  * - Opciones de salida: `out` recibe cada error según se detecta (el
+  *   modo normal usa stdout, con la repetición por nivel del ejercicio);
+  *   con out == NULL el parser no escribe nada
+  * - Aritmética: la que usa vbc_eval (AR_WRAP tras vbc_ctx_init; para
+  *   otro modo, arith_init(&ctx.ar, ...) antes de evaluar)
+  * - VBC_HEAP: nodos con calloc, que se liberan con destroy_tree() y se
+  *   pueden mezclar con mk_op y compañía (lo que usa el resto del fichero)
+  */
+ enum {
+	 VBC_VARS = 1,      // Acepta variables a-z (nodos VAR)
+	 VBC_HEAP = 2       // Nodos con calloc en vez de la arena
+ };
+ 
+ typedef struct vbc_block {
+	 struct vbc_block *next;
+	 size_t cap;        // Nodos en este bloque
+	 node nodes[];
+ } vbc_block;
+ 
+ typedef struct vbc_ctx {
+	 vbc_block *blocks;    // Primer bloque de la arena
+	 vbc_block *cur;       // Bloque en uso
+	 size_t used;          // Nodos ocupados en cur
+	 int flags;            // VBC_VARS | VBC_HEAP
+	 FILE *out;            // Eco de errores (NULL: solo en err)
+	 const char *src;      // Entrada del parse en curso
+	 long err_pos;         // Offset del error en src (-1: sin error)
+	 char err[48];         // Mensaje del primer error ("" si no hay)
+	 arith ar;             // Semántica de vbc_eval
+ } vbc_ctx;
+ 
  // Declaraciones de funciones
  node *parse_expression(char **s);
- node *parse_addition(char **s);
- node *parse_multiplication(char **s);
- node *parse_primary(char **s);
+ node *parse_addition(vbc_ctx *ctx, char **s);
+ node *parse_multiplication(vbc_ctx *ctx, char **s);
+ node *parse_primary(vbc_ctx *ctx, char **s);
  node *new_node(node n);
  void destroy_tree(node *n);
  int eval_tree(node *tree);
+ int eval_tree_env(node *tree, const int *env, const arith *a);
+ int ar_leaf(const arith *a, int v);
+ int ar_op(const arith *a, int type, int x, int y);
  void unexpected(char c);
  int accept(char **s, char c);
  int expect(char **s, char c);
@@ -55,6 +212,7 @@
 	 node *ret = calloc(1, sizeof(node));
 	 if (!ret)
 		 return NULL;
+	 PROF(g_prof.allocs++; g_prof.nodes[n.type]++);
 	 *ret = n;
 	 return ret;
  }
@@ -67,11 +225,12 @@
 	 if (!n)
 		 return;
 	 
-	 if (n->type != VAL)
+	 if (n->type != VAL && n->type != VAR)
 	 {
 		 destroy_tree(n->l);
 		 destroy_tree(n->r);
 	 }
+	 PROF(g_prof.frees++);
 	 free(n);
  }
  
@@ -104,11 +263,78 @@
 	 return 0;
  }
  
+ /*
+  * ERRORES Y NODOS DEL CONTEXTO:
+  * - ctx_error guarda el primer error y hace eco de todos en ctx->out,
+  *   igual que unexpected() (que se llama una vez por nivel)
+  * - ctx_node reserva de la arena o del heap según VBC_HEAP
+  * - ctx_drop libera un subárbol descartado; en la arena no hace nada,
+  *   vbc_parse_at rebobina la arena entera si el parse falla
+  */
+ static void ctx_error(vbc_ctx *ctx, const char *s)
+ {
+	 if (ctx->err_pos < 0)
+	 {
+		 ctx->err_pos = s - ctx->src;
+		 if (*s)
+			 snprintf(ctx->err, sizeof(ctx->err), "Unexpected token '%c'", *s);
+		 else
+			 snprintf(ctx->err, sizeof(ctx->err), "Unexpected end of input");
+	 }
+	 if (ctx->out)
+	 {
+		 if (*s)
+			 fprintf(ctx->out, "Unexpected token '%c'\n", *s);
+		 else
+			 fprintf(ctx->out, "Unexpected end of input\n");
+	 }
+ }
+ 
+ static node *ctx_node(vbc_ctx *ctx, node n)
+ {
+	 vbc_block *b;
+	 size_t cap;
+	 
+	 if (ctx->flags & VBC_HEAP)
+		 return new_node(n);
+	 if (!ctx->cur || ctx->used == ctx->cur->cap)
+	 {
+		 b = ctx->cur ? ctx->cur->next : ctx->blocks;
+		 if (!b)
+		 {
+			 // Bloques de 256 nodos que doblan hasta 64K
+			 cap = ctx->cur ? ctx->cur->cap * 2 : 256;
+			 if (cap > 65536)
+				 cap = 65536;
+			 b = malloc(sizeof(vbc_block) + cap * sizeof(node));
+			 if (!b)
+				 return NULL;
+			 b->next = NULL;
+			 b->cap = cap;
+			 if (ctx->cur)
+				 ctx->cur->next = b;
+			 else
+				 ctx->blocks = b;
+		 }
+		 ctx->cur = b;
+		 ctx->used = 0;
+	 }
+	 PROF(g_prof.allocs++; g_prof.nodes[n.type]++);
+	 ctx->cur->nodes[ctx->used] = n;
+	 return &ctx->cur->nodes[ctx->used++];
+ }
+ 
+ static void ctx_drop(vbc_ctx *ctx, node *n)
+ {
+	 if (ctx->flags & VBC_HEAP)
+		 destroy_tree(n);
+ }
+ 
  /*
   * PARSER DE ELEMENTOS PRIMARIOS:
   * primary → NUMBER | '(' expression ')'
   */
- node *parse_primary(char **s)
+ node *parse_primary(vbc_ctx *ctx, char **s)
  {
 	 /*
 	  * ELEMENTOS PRIMARIOS:
@@ -127,12 +353,15 @@
 		  * - Esperar ')'
 		  */
 		 (*s)++;  // Consumir '('
-		 res = parse_addition(s);  // Parsear expresión interna
+		 PROF(if (++g_prof.depth > g_prof.max_depth) g_prof.max_depth = g_prof.depth);
+		 res = parse_addition(ctx, s);  // Parsear expresión interna
+		 PROF(g_prof.depth--);
 		 
 		 if (!res || **s != ')')
 		 {
-			 destroy_tree(res);
-			 unexpected(**s);
+			 if (res)
+				 ctx_drop(ctx, res);
+			 ctx_error(ctx, *s);
 			 return NULL;
 		 }
 		 
@@ -153,13 +382,26 @@
 		 tmp.l = NULL;
 		 tmp.r = NULL;
 		 
-		 res = new_node(tmp);
+		 res = ctx_node(ctx, tmp);
 		 (*s)++;  // Consumir dígito
 		 return res;
 	 }
 	 
+	 if ((ctx->flags & VBC_VARS) && islower(**s))
+	 {
+		 // VARIABLE (solo con VBC_VARS): una letra minúscula
+		 tmp.type = VAR;
+		 tmp.val = **s - 'a';
+		 tmp.l = NULL;
+		 tmp.r = NULL;
+		 
+		 res = ctx_node(ctx, tmp);
+		 (*s)++;
+		 return res;
+	 }
+	 
 	 // Token inesperado
-	 unexpected(**s);
+	 ctx_error(ctx, *s);
 	 return NULL;
  }
  
@@ -167,7 +409,7 @@
   * PARSER DE MULTIPLICACIÓN:
   * multiplication → primary (('*') primary)*
   */
- node *parse_multiplication(char **s)
+ node *parse_multiplication(vbc_ctx *ctx, char **s)
  {
 	 /*
 	  * PARSING DE MULTIPLICACIÓN:
@@ -179,7 +421,7 @@
 	 node *right;
 	 node tmp;
 	 
-	 left = parse_primary(s);
+	 left = parse_primary(ctx, s);
 	 if (!left)
 		 return NULL;
 	 
@@ -187,10 +429,10 @@
 	 {
 		 (*s)++;  // Consumir '*'
 		 
-		 right = parse_primary(s);
+		 right = parse_primary(ctx, s);
 		 if (!right)
 		 {
-			 destroy_tree(left);
+			 ctx_drop(ctx, left);
 			 return NULL;
 		 }
 		 
@@ -200,10 +442,11 @@
 		 tmp.r = right;
 		 tmp.val = 0;  // No usado en nodos operadores
 		 
-		 left = new_node(tmp);
+		 left = ctx_node(ctx, tmp);
 		 if (!left)
 		 {
-			 destroy_tree(right);
+			 ctx_drop(ctx, tmp.l);
+			 ctx_drop(ctx, right);
 			 return NULL;
 		 }
 	 }
@@ -215,7 +458,7 @@
   * PARSER DE SUMA:
   * addition → multiplication (('+') multiplication)*
   */
- node *parse_addition(char **s)
+ node *parse_addition(vbc_ctx *ctx, char **s)
  {
 	 /*
 	  * PARSING DE SUMA:
@@ -228,7 +471,7 @@
 	 node *right;
 	 node tmp;
 	 
-	 left = parse_multiplication(s);
+	 left = parse_multiplication(ctx, s);
 	 if (!left)
 		 return NULL;
 	 
@@ -236,10 +479,10 @@
 	 {
 		 (*s)++;  // Consumir '+'
 		 
-		 right = parse_multiplication(s);
+		 right = parse_multiplication(ctx, s);
 		 if (!right)
 		 {
-			 destroy_tree(left);
+			 ctx_drop(ctx, left);
 			 return NULL;
 		 }
 		 
@@ -249,10 +492,11 @@
 		 tmp.r = right;
 		 tmp.val = 0;  // No usado en nodos operadores
 		 
-		 left = new_node(tmp);
+		 left = ctx_node(ctx, tmp);
 		 if (!left)
 		 {
-			 destroy_tree(right);
+			 ctx_drop(ctx, tmp.l);
+			 ctx_drop(ctx, right);
 			 return NULL;
 		 }
 	 }
@@ -263,30 +507,282 @@
  /*
   * PARSER DE EXPRESIÓN COMPLETA:
   */
- node *parse_expression(char **s)
+ node *vbc_parse_at(vbc_ctx *ctx, char **s)
  {
 	 /*
 	  * PARSER PRINCIPAL:
 	  * - Parsear expresión completa
 	  * - Verificar que no queden caracteres sin parsear
-	  * - Manejar errores de parsing
+	  * - Manejar errores de parsing (si falla, la arena vuelve a como
+	  *   estaba antes de empezar)
 	  */
-	 node *ret = parse_addition(s);
+	 vbc_block *mark_block = ctx->cur;
+	 size_t mark_used = ctx->used;
+	 node *ret;
 	 
-	 if (!ret)
-		 return NULL;
+	 ctx->src = *s;
+	 ctx->err_pos = -1;
+	 ctx->err[0] = '\0';
+	 ret = parse_addition(ctx, s);
 	 
 	 // Verificar que se consumió toda la entrada
-	 if (**s)
+	 if (ret && **s)
 	 {
-		 destroy_tree(ret);
-		 unexpected(**s);
-		 return NULL;
+		 ctx_drop(ctx, ret);
+		 ctx_error(ctx, *s);
+		 ret = NULL;
 	 }
-	 
+	 if (!ret && !(ctx->flags & VBC_HEAP))
+	 {
+		 ctx->cur = mark_block;
+		 ctx->used = mark_used;
+	 }
+	 if (!ret && ctx->err_pos < 0)
+		 snprintf(ctx->err, sizeof(ctx->err), "Out of memory");
 	 return ret;
  }
  
+ /*
+  * API DEL CONTEXTO:
+  * - vbc_ctx_init / vbc_ctx_free: crear y destruir (el contexto es del
+  *   llamante, puede estar en la pila)
+  * - vbc_parse: compila una fórmula en la arena; NULL si hay error y
+  *   vbc_error() lo describe
+  * - vbc_eval: evalúa con la aritmética del contexto (env con el valor
+  *   de cada letra, o NULL)
+  * - vbc_reset: invalida los árboles del contexto y deja la memoria
+  *   lista para el siguiente parse, sin llamar a malloc ni a free
+  *
+  *   vbc_ctx ctx;
+  *   vbc_ctx_init(&ctx, VBC_VARS, NULL);
+  *   for (...) {
+  *       node *t = vbc_parse(&ctx, formula);
+  *       r = t ? vbc_eval(&ctx, t, env) : fallo(vbc_error(&ctx));
+  *       vbc_reset(&ctx);
+  *   }
+  *   vbc_ctx_free(&ctx);
+  */
+ void vbc_ctx_init(vbc_ctx *ctx, int flags, FILE *out)
+ {
+	 memset(ctx, 0, sizeof(*ctx));
+	 ctx->flags = flags;
+	 ctx->out = out;
+	 ctx->err_pos = -1;
+	 ctx->ar = ar_wrap;
+ }
+ 
+ void vbc_ctx_free(vbc_ctx *ctx)
+ {
+	 vbc_block *b;
+	 
+	 while (ctx->blocks)
+	 {
+		 b = ctx->blocks;
+		 ctx->blocks = b->next;
+		 free(b);
+	 }
+	 ctx->cur = NULL;
+	 ctx->used = 0;
+ }
+ 
+ void vbc_reset(vbc_ctx *ctx)
+ {
+	 ctx->cur = NULL;
+	 ctx->used = 0;
+ }
+ 
+ node *vbc_parse(vbc_ctx *ctx, const char *src)
+ {
+	 char *s = (char *)src;  // El parser no escribe en la entrada
+	 
+	 return vbc_parse_at(ctx, &s);
+ }
+ 
+ const char *vbc_error(const vbc_ctx *ctx)
+ {
+	 return ctx->err;
+ }
+ 
+ int vbc_eval(const vbc_ctx *ctx, node *tree, const int *env)
+ {
+	 static const int zeros[26];
+	 
+	 return eval_tree_env(tree, env ? env : zeros, &ctx->ar);
+ }
+ 
+ /*
+  * Entrada clásica (modo normal y el resto de modos): nodos en el heap
+  * y errores en stdout como en el ejercicio
+  */
+ node *parse_expression(char **s)
+ {
+	 vbc_ctx ctx;
+	 
+	 vbc_ctx_init(&ctx, VBC_HEAP, stdout);
+	 return vbc_parse_at(&ctx, s);
+ }
+ 
+ // Igual, aceptando variables (--grad, --analyze, benchmarks)
+ node *parse_expression_vars(char **s)
+ {
+	 vbc_ctx ctx;
+	 
+	 vbc_ctx_init(&ctx, VBC_HEAP | VBC_VARS, stdout);
+	 return vbc_parse_at(&ctx, s);
+ }
+ 
+ /*
+  * VALIDACIÓN CON RECUPERACIÓN DE ERRORES (--lint):
+  * - Mismo recorrido que el parser, pero sin construir el AST y sin
+  *   detenerse en el primer error
+  * - Cada error se informa como "<fichero>:<línea>:<columna>: <mensaje>"
+  *   con los mismos mensajes que unexpected()
+  * - Recuperación en modo pánico: tras un error se descartan caracteres
+  *   hasta un punto de sincronización ('+', '*', ')' o fin de línea)
+  *   y se sigue validando desde ahí
+  * - El primer error de cada línea coincide con el que imprimiría el
+  *   modo normal para esa misma fórmula
+  */
+ typedef struct lint {
+	 const char *file;
+	 const char *start;   // Inicio de la línea actual (para la columna)
+	 const char *s;       // Posición actual
+	 const char *last;    // Posición del último error (evita duplicados)
+	 long line;
+	 long errors;
+ } lint;
+ 
+ static void lint_report(lint *st)
+ {
+	 char c = *st->s;
+	 
+	 if (st->s == st->last)
+		 return;
+	 st->last = st->s;
+	 printf("%s:%ld:%ld: ", st->file, st->line, (long)(st->s - st->start) + 1);
+	 if (c)
+		 printf("Unexpected token '%c'\n", c);
+	 else
+		 printf("Unexpected end of input\n");
+	 st->errors++;
+ }
+ 
+ static int lint_is_sync(char c)
+ {
+	 return c == '+' || c == '*' || c == ')' || c == '\0';
+ }
+ 
+ // Descarta al menos el carácter erróneo y avanza hasta un punto de sync
+ static void lint_skip(lint *st, int keep_paren)
+ {
+	 do
+		 st->s++;
+	 while (!lint_is_sync(*st->s) || (*st->s == ')' && !keep_paren));
+ }
+ 
+ static void lint_addition(lint *st);
+ 
+ /*
+  * Grupo entre paréntesis o fórmula completa: se repite mientras la
+  * recuperación deje un operador del que continuar
+  */
+ static void lint_group(lint *st, char close)
+ {
+	 for (;;)
+	 {
+		 lint_addition(st);
+		 if (*st->s == close)
+			 break;
+		 lint_report(st);
+		 if (!*st->s)
+			 return;
+		 lint_skip(st, close == ')');
+		 if (*st->s == close || !*st->s)
+			 break;
+		 st->s++;  // Consumir el operador y seguir
+	 }
+	 if (*st->s)
+		 st->s++;
+ }
+ 
+ static void lint_primary(lint *st)
+ {
+	 if (*st->s == '(')
+	 {
+		 st->s++;
+		 lint_group(st, ')');
+		 return;
+	 }
+	 if (isdigit((unsigned char)*st->s))
+	 {
+		 st->s++;
+		 return;
+	 }
+	 lint_report(st);
+	 if (!lint_is_sync(*st->s))
+		 lint_skip(st, 1);
+ }
+ 
+ static void lint_multiplication(lint *st)
+ {
+	 lint_primary(st);
+	 while (*st->s == '*')
+	 {
+		 st->s++;
+		 lint_primary(st);
+	 }
+ }
+ 
+ static void lint_addition(lint *st)
+ {
+	 lint_multiplication(st);
+	 while (*st->s == '+')
+	 {
+		 st->s++;
+		 lint_multiplication(st);
+	 }
+ }
+ 
+ /*
+  * MODO --lint:
+  * - Una fórmula por línea, del fichero indicado o de stdin
+  * - Resumen en stderr; código de salida 1 si hubo algún error
+  */
+ static int lint_main(const char *path)
+ {
+	 FILE *in = stdin;
+	 char *line = NULL;
+	 size_t cap = 0;
+	 ssize_t len;
+	 long bad = 0;
+	 long before;
+	 lint st;
+	 
+	 if (path && !(in = fopen(path, "r")))
+		 return 1;
+	 st.file = path ? path : "<stdin>";
+	 st.line = 0;
+	 st.errors = 0;
+	 while ((len = getline(&line, &cap, in)) != -1)
+	 {
+		 if (len > 0 && line[len - 1] == '\n')
+			 line[len - 1] = '\0';
+		 st.line++;
+		 st.start = line;
+		 st.s = line;
+		 st.last = NULL;
+		 before = st.errors;
+		 lint_group(&st, '\0');
+		 bad += (st.errors != before);
+	 }
+	 free(line);
+	 if (in != stdin)
+		 fclose(in);
+	 fprintf(stderr, "%ld error(s) in %ld of %ld formula(s)\n",
+		 st.errors, bad, st.line);
+	 return st.errors != 0;
+ }
+ 
  /*
   * EVALUADOR DEL AST:
   */
@@ -298,6 +794,7 @@
 	  * - Para nodos ADD: evaluar hijos y sumar
 	  * - Para nodos MULTI: evaluar hijos y multiplicar
 	  */
+	 PROF(g_prof.evals[tree->type]++);
 	 switch (tree->type)
 	 {
 		 case ADD:
@@ -308,27 +805,2819 @@
 			 
 		 case VAL:
 			 return tree->val;
+			 
+		 case VAR:
+			 return 0;  // Sin entorno: ver eval_tree_env()
 	 }
 	 
 	 return 0;  // No debería llegar aquí
  }
  
  /*
-  * FUNCIÓN MAIN:
+  * Prepara las constantes del modo; devuelve -1 si p no es válido
+  * (p debe ser impar para Montgomery y menor que 2^31 para que
+  * las sumas no desborden 32 bits)
   */
- int main(int argc, char **argv)
+ int arith_init(arith *a, arith_mode mode, unsigned p)
  {
-	 if (argc != 2)
-		 return 1;
+	 unsigned inv;
+	 unsigned r;
+	 int i;
 	 
-	 char *input = argv[1];
-	 node *tree = parse_expression(&input);
+	 memset(a, 0, sizeof(*a));
+	 a->mode = mode;
+	 if (mode != AR_MOD)
+		 return 0;
+	 if (p < 3 || !(p & 1) || p >= (1u << 31))
+		 return -1;
+	 a->p = p;
+	 a->m = ~0ULL / p;
+	 // Newton: cada iteración duplica los bits correctos de p^-1
+	 inv = p;
+	 for (i = 0; i < 5; i++)
+		 inv *= 2 - p * inv;
+	 a->pinv = -inv;
+	 r = (unsigned)((1ULL << 32) % p);
+	 a->r2 = (unsigned)((unsigned long long)r * r % p);
+	 return 0;
+ }
+ 
+ static inline unsigned barrett(const arith *a, unsigned long long x)
+ {
+	 unsigned long long q = (unsigned long long)(((unsigned __int128)x * a->m) >> 64);
+	 unsigned long long r = x - q * a->p;
 	 
-	 if (!tree)
-		 return 1;
+	 return (unsigned)(r >= a->p ? r - a->p : r);
+ }
+ 
+ static inline int sat(long long x)
+ {
+	 if (x > INT_MAX)
+		 return INT_MAX;
+	 if (x < INT_MIN)
+		 return INT_MIN;
+	 return (int)x;
+ }
+ 
+ // Un literal entra en el dominio del modo (en AR_MOD, reducido a [0, p))
+ int ar_leaf(const arith *a, int v)
+ {
+	 long long r;
+	 
+	 if (a->mode != AR_MOD)
+		 return v;
+	 r = v % (long long)a->p;
+	 return (int)(r < 0 ? r + a->p : r);
+ }
+ 
+ int ar_op(const arith *a, int type, int x, int y)
+ {
+	 switch (a->mode)
+	 {
+		 case AR_WRAP:
+			 return (int)(type == ADD ? (unsigned)x + (unsigned)y
+				 : (unsigned)x * (unsigned)y);
+		 case AR_SAT:
+			 return sat(type == ADD ? (long long)x + y : (long long)x * y);
+		 case AR_MOD:
+			 if (type == ADD)
+				 return (int)barrett(a, (unsigned long long)x + (unsigned)y);
+			 return (int)barrett(a, (unsigned long long)x * (unsigned)y);
+	 }
+	 return 0;
+ }
+ 
+ int eval_tree_ar(node *tree, const arith *a)
+ {
+	 PROF(g_prof.evals[tree->type]++);
+	 if (tree->type == VAL)
+		 return ar_leaf(a, tree->val);
+	 return ar_op(a, tree->type, eval_tree_ar(tree->l, a),
+		 eval_tree_ar(tree->r, a));
+ }
+ 
+ /*
+  * VARIABLES Y DERIVADAS SIMBÓLICAS (--grad):
+  * - Con VBC_VARS, primary acepta además una letra minúscula:
+  *   primary → NUMBER | VARIABLE | '(' expression ')'
+  *   (nodo VAR, val = índice de la letra 0-25)
+  * - Fuera del modo --grad la gramática es la del ejercicio
+  * - Las variables solo existen en eval_tree_env y en este bloque;
+  *   el resto de evaluadores (flat, incr, emit, db) sigue siendo
+  *   solo para expresiones constantes
+  * - Las variables entran por ar_leaf como los literales (en AR_MOD,
+  *   reducidas a [0, p))
+  */
+ int eval_tree_env(node *tree, const int *env, const arith *a)
+ {
+	 if (tree->type == VAL)
+		 return ar_leaf(a, tree->val);
+	 if (tree->type == VAR)
+		 return ar_leaf(a, env[tree->val]);
+	 return ar_op(a, tree->type, eval_tree_env(tree->l, env, a),
+		 eval_tree_env(tree->r, env, a));
+ }
+ 
+ /*
+  * CONSTRUCTORES CON SIMPLIFICACIÓN:
+  * - mk_op aplica las reglas locales al crear cada nodo, así la
+  *   derivada nunca llega a materializar los términos triviales:
+  *     c1 op c2 → constante plegada (con la aritmética `a`)
+  *     0 + x → x,  x + 0 → x
+  *     0 * x → 0,  x * 0 → 0,  1 * x → x,  x * 1 → x
+  * - Consumen (liberan) los hijos que descartan
+  * - Devuelven NULL si falla una reserva (y liberan lo recibido)
+  */
+ static node *mk_val(int v)
+ {
+	 node tmp;
 	 
-	 printf("%d\n", eval_tree(tree));
+	 tmp.type = VAL;
+	 tmp.val = v;
+	 tmp.l = NULL;
+	 tmp.r = NULL;
+	 return new_node(tmp);
+ }
+ 
+ static int is_const(node *n, int v)
+ {
+	 return n->type == VAL && n->val == v;
+ }
+ 
+ static node *mk_op(const arith *a, int type, node *l, node *r)
+ {
+	 node tmp;
+	 node *res;
+	 
+	 if (!l || !r)
+	 {
+		 destroy_tree(l);
+		 destroy_tree(r);
+		 return NULL;
+	 }
+	 if (l->type == VAL && r->type == VAL)
+	 {
+		 l->val = ar_op(a, type, ar_leaf(a, l->val), ar_leaf(a, r->val));
+		 destroy_tree(r);
+		 return l;
+	 }
+	 if (type == MULTI && (is_const(l, 0) || is_const(r, 0)))
+	 {
+		 destroy_tree(l);
+		 destroy_tree(r);
+		 return mk_val(0);
+	 }
+	 if ((type == ADD && is_const(l, 0)) || (type == MULTI && is_const(l, 1)))
+	 {
+		 destroy_tree(l);
+		 return r;
+	 }
+	 if ((type == ADD && is_const(r, 0)) || (type == MULTI && is_const(r, 1)))
+	 {
+		 destroy_tree(r);
+		 return l;
+	 }
+	 tmp.type = type;
+	 tmp.val = 0;
+	 tmp.l = l;
+	 tmp.r = r;
+	 res = new_node(tmp);
+	 if (!res)
+	 {
+		 destroy_tree(l);
+		 destroy_tree(r);
+	 }
+	 return res;
+ }
+ 
+ node *copy_tree(node *n, const arith *a)
+ {
+	 if (n->type == VAL || n->type == VAR)
+		 return new_node(*n);
+	 return mk_op(a, n->type, copy_tree(n->l, a), copy_tree(n->r, a));
+ }
+ 
+ /*
+  * DERIVADA PARCIAL respecto a la variable `var`:
+  *   d(c) = 0,  d(x) = 1 si x es var,  d(a + b) = da + db,
+  *   d(a * b) = da * b + a * db
+  */
+ node *derive(node *n, int var, const arith *a)
+ {
+	 switch (n->type)
+	 {
+		 case VAL:
+			 return mk_val(0);
+		 case VAR:
+			 return mk_val(n->val == var);
+		 case ADD:
+			 return mk_op(a, ADD, derive(n->l, var, a), derive(n->r, var, a));
+		 case MULTI:
+			 return mk_op(a, ADD,
+				 mk_op(a, MULTI, derive(n->l, var, a), copy_tree(n->r, a)),
+				 mk_op(a, MULTI, copy_tree(n->l, a), derive(n->r, var, a)));
+	 }
+	 return NULL;
+ }
+ 
+ // Imprime con los paréntesis mínimos: solo + dentro de *, y el hijo
+ // derecho del mismo operador (la gramática asocia por la izquierda)
+ void print_tree(FILE *out, node *n, int need)
+ {
+	 int wrap;
+	 
+	 if (n->type == VAL)
+	 {
+		 fprintf(out, "%d", n->val);
+		 return;
+	 }
+	 if (n->type == VAR)
+	 {
+		 fputc('a' + n->val, out);
+		 return;
+	 }
+	 wrap = need & (n->type == ADD ? 1 : 2);
+	 if (wrap)
+		 fputc('(', out);
+	 print_tree(out, n->l, n->type == ADD ? 0 : 1);
+	 fputc(n->type == ADD ? '+' : '*', out);
+	 print_tree(out, n->r, n->type == ADD ? 1 : 3);
+	 if (wrap)
+		 fputc(')', out);
+ }
+ 
+ /*
+  * VALOR + GRADIENTE EN UNA SOLA PASADA:
+  * - Modo directo (números duales): cada nodo devuelve su valor y en
+  *   g[] sus derivadas respecto a las nv variables presentes
+  *   (slot[letra] = posición en g, o -1 si no aparece)
+  * - El gradiente del hijo derecho va al siguiente tramo de ws, así
+  *   que ws necesita profundidad(árbol) * nv enteros
+  * - Da los mismos números que evaluar el árbol original y cada árbol
+  *   de derive(), pero en un único recorrido
+  * - AR_WRAP y AR_MOD: las reglas de la derivada valen en cualquier
+  *   anillo. AR_SAT no lo es (la saturación rompe la distributiva),
+  *   así que --grad la rechaza
+  */
+ static unsigned eval_dual(node *n, const arith *ar, const int *env, const int *slot,
+	 int nv, unsigned *g, unsigned *ws)
+ {
+	 unsigned a;
+	 unsigned b;
+	 int i;
+	 
+	 if (n->type == VAL || n->type == VAR)
+	 {
+		 memset(g, 0, nv * sizeof(*g));
+		 if (n->type == VAL)
+			 return ar_leaf(ar, n->val);
+		 if (slot[n->val] >= 0)
+			 g[slot[n->val]] = 1;
+		 return ar_leaf(ar, env[n->val]);
+	 }
+	 a = eval_dual(n->l, ar, env, slot, nv, g, ws);
+	 b = eval_dual(n->r, ar, env, slot, nv, ws, ws + nv);
+	 if (ar->mode == AR_MOD)
+	 {
+		 for (i = 0; i < nv; i++)
+			 g[i] = n->type == ADD ? ar_op(ar, ADD, g[i], ws[i])
+				 : ar_op(ar, ADD, ar_op(ar, MULTI, g[i], b), ar_op(ar, MULTI, a, ws[i]));
+		 return ar_op(ar, n->type, a, b);
+	 }
+	 if (n->type == ADD)
+	 {
+		 for (i = 0; i < nv; i++)
+			 g[i] += ws[i];
+		 return a + b;
+	 }
+	 for (i = 0; i < nv; i++)
+		 g[i] = g[i] * b + a * ws[i];
+	 return a * b;
+ }
+ 
+ static int tree_depth(node *n)
+ {
+	 int l;
+	 int r;
+	 
+	 if (n->type == VAL || n->type == VAR)
+		 return 1;
+	 l = tree_depth(n->l);
+	 r = tree_depth(n->r);
+	 return 1 + (l > r ? l : r);
+ }
+ 
+ static void collect_vars(node *n, int *slot)
+ {
+	 if (n->type == VAR)
+		 slot[n->val] = 1;
+	 else if (n->type != VAL)
+	 {
+		 collect_vars(n->l, slot);
+		 collect_vars(n->r, slot);
+	 }
+ }
+ 
+ // Asigna a cada variable presente su posición en el gradiente
+ // (slot[letra], -1 si no aparece) y devuelve cuántas hay
+ int grad_vars(node *tree, int *slot)
+ {
+	 int nv = 0;
+	 int i;
+	 
+	 for (i = 0; i < 26; i++)
+		 slot[i] = 0;
+	 collect_vars(tree, slot);
+	 for (i = 0; i < 26; i++)
+		 slot[i] = slot[i] ? nv++ : -1;
+	 return nv;
+ }
+ 
+ /*
+  * Evalúa valor y gradiente con la aritmética `a` (AR_WRAP o AR_MOD);
+  * grad debe tener sitio para las nv variables de grad_vars().
+  * Devuelve -1 si falla la reserva o el modo es AR_SAT.
+  */
+ int eval_grad(node *tree, const arith *a, const int *env, const int *slot, int nv,
+	 int *value, int *grad)
+ {
+	 unsigned *ws;
+	 
+	 if (a->mode == AR_SAT)
+		 return -1;
+	 ws = malloc(((size_t)tree_depth(tree) + 1) * (nv + 1) * sizeof(*ws));
+	 if (!ws)
+		 return -1;
+	 *value = (int)eval_dual(tree, a, env, slot, nv, (unsigned *)grad, ws);
+	 free(ws);
+	 return 0;
+ }
+ 
+ /*
+  * MODO --grad:
+  * - vbc [--wrap|--mod p] --grad '<expr>' [x=3 y=-2 ...]  (variables no
+  *   dadas valen 0); con --sat da error
+  * - Primera línea: el valor, como en el modo normal
+  * - Después, por variable: "d/dx: <derivada simplificada> = <valor>"
+  */
+ static int grad_main(char *input, int argc, char **assign, const arith *a)
+ {
+	 int env[26] = {0};
+	 int slot[26];
+	 int *grad;
+	 node *tree;
+	 int value;
+	 int nv;
+	 int i;
+	 
+	 if (a->mode == AR_SAT)
+	 {
+		 fprintf(stderr, "vbc: --grad does not support --sat\n");
+		 return 1;
+	 }
+	 for (i = 0; i < argc; i++)
+	 {
+		 if (!islower((unsigned char)assign[i][0]) || assign[i][1] != '=')
+			 return 1;
+		 env[assign[i][0] - 'a'] = atoi(assign[i] + 2);
+	 }
+	 tree = parse_expression_vars(&input);
+	 if (!tree)
+		 return 1;
+	 nv = grad_vars(tree, slot);
+	 grad = malloc((nv + 1) * sizeof(*grad));
+	 if (!grad || eval_grad(tree, a, env, slot, nv, &value, grad) == -1)
+	 {
+		 free(grad);
+		 destroy_tree(tree);
+		 return 1;
+	 }
+	 printf("%d\n", value);
+	 for (i = 0; i < 26; i++)
+	 {
+		 node *d;
+		 
+		 if (slot[i] < 0)
+			 continue;
+		 d = derive(tree, i, a);
+		 if (!d)
+			 break;
+		 printf("d/d%c: ", 'a' + i);
+		 print_tree(stdout, d, 0);
+		 printf(" = %d\n", grad[slot[i]]);
+		 destroy_tree(d);
+	 }
+	 free(grad);
+	 destroy_tree(tree);
+	 return 0;
+ }
+ 
+ /*
+  * CORTOCIRCUITO EN MULTIPLICACIONES:
+  * - En MULTI se evalúa primero el hijo más barato según el coste
+  *   estático (nodos del subárbol); si vale 0 el otro no se evalúa
+  * - Los costes van en una tabla aparte, no en los nodos: sc_sizes()
+  *   guarda el tamaño de cada subárbol en pre-orden, así el hijo
+  *   izquierdo de la entrada i es i + 1 y el derecho i + 1 + size[i + 1],
+  *   y saltarse un subárbol no desincroniza nada
+  * - 0 * x = 0 en los tres modos (también con desbordamiento), así que
+  *   el resultado es siempre el de eval_tree_env con la misma `a`
+  */
+ int sc_sizes(node *n, int *size)
+ {
+	 int l;
+	 
+	 if (n->type == VAL || n->type == VAR)
+		 return size[0] = 1;
+	 l = sc_sizes(n->l, size + 1);
+	 size[0] = 1 + l + sc_sizes(n->r, size + 1 + l);
+	 return size[0];
+ }
+ 
+ // size: la tabla de sc_sizes(tree), que tiene un entero por nodo
+ int eval_tree_sc(node *tree, const int *env, const int *size, const arith *a)
+ {
+	 const int *sl = size + 1;
+	 const int *sr;
+	 int x;
+	 
+	 PROF(g_prof.evals[tree->type]++);
+	 if (tree->type == VAL)
+		 return ar_leaf(a, tree->val);
+	 if (tree->type == VAR)
+		 return ar_leaf(a, env[tree->val]);
+	 sr = sl + *sl;
+	 if (tree->type == ADD)
+		 return ar_op(a, ADD, eval_tree_sc(tree->l, env, sl, a),
+			 eval_tree_sc(tree->r, env, sr, a));
+	 if (*sr < *sl)
+	 {
+		 x = eval_tree_sc(tree->r, env, sr, a);
+		 return x ? ar_op(a, MULTI, x, eval_tree_sc(tree->l, env, sl, a)) : 0;
+	 }
+	 x = eval_tree_sc(tree->l, env, sl, a);
+	 return x ? ar_op(a, MULTI, x, eval_tree_sc(tree->r, env, sr, a)) : 0;
+ }
+ 
+ /*
+  * ANÁLISIS DE INTERVALOS:
+  * - Dado un rango [lo, hi] por variable, calcula el rango de cada
+  *   subárbol con aritmética de intervalos en 64 bits
+  * - Cada rango exacto se ajusta al modo de aritmética (ivl_fit):
+  *   AR_WRAP: si se sale de int, el desbordamiento lo hace arbitrario
+  *   y el subárbol pasa a "cualquier int"... salvo que se multiplique
+  *   por algo que es exactamente 0
+  *   AR_SAT: la saturación es monótona, se saturan los extremos
+  *   AR_MOD: si el rango no cae entero en un mismo tramo [kp, kp + p)
+  *   pasa a [0, p - 1]; si cae, se reducen los extremos
+  * - Los operandos siempre están en el dominio del modo, así que los
+  *   productos y sumas de 64 bits no desbordan
+  * - Un subárbol con lo == hi es constante para cualquier valor de sus
+  *   variables: interval_fold() lo sustituye por un VAL, de modo que
+  *   ningún evaluador vuelve a recorrerlo
+  */
+ typedef struct ivl {
+	 long long lo;
+	 long long hi;
+ } ivl;
+ 
+ static const ivl ivl_any = {INT_MIN, INT_MAX};
+ 
+ static ivl ivl_clamp(long long lo, long long hi)
+ {
+	 ivl r;
+	 
+	 if (lo < INT_MIN || hi > INT_MAX)
+		 return ivl_any;
+	 r.lo = lo;
+	 r.hi = hi;
+	 return r;
+ }
+ 
+ static ivl ivl_fit(const arith *ar, long long lo, long long hi)
+ {
+	 ivl r;
+	 
+	 if (ar->mode == AR_WRAP)
+		 return ivl_clamp(lo, hi);
+	 if (ar->mode == AR_SAT)
+	 {
+		 r.lo = sat(lo);
+		 r.hi = sat(hi);
+		 return r;
+	 }
+	 r.lo = ((lo % ar->p) + ar->p) % ar->p;
+	 r.hi = ((hi % ar->p) + ar->p) % ar->p;
+	 if (hi - lo >= ar->p || r.lo > r.hi)
+	 {
+		 r.lo = 0;
+		 r.hi = ar->p - 1;
+	 }
+	 return r;
+ }
+ 
+ static ivl ivl_op(const arith *ar, int type, ivl a, ivl b)
+ {
+	 long long p[4];
+	 long long lo;
+	 long long hi;
+	 int i;
+	 
+	 if (type == ADD)
+		 return ivl_fit(ar, a.lo + b.lo, a.hi + b.hi);
+	 if ((a.lo == 0 && a.hi == 0) || (b.lo == 0 && b.hi == 0))
+		 return ivl_fit(ar, 0, 0);
+	 p[0] = a.lo * b.lo;
+	 p[1] = a.lo * b.hi;
+	 p[2] = a.hi * b.lo;
+	 p[3] = a.hi * b.hi;
+	 lo = p[0];
+	 hi = p[0];
+	 for (i = 1; i < 4; i++)
+	 {
+		 if (p[i] < lo)
+			 lo = p[i];
+		 if (p[i] > hi)
+			 hi = p[i];
+	 }
+	 return ivl_fit(ar, lo, hi);
+ }
+ 
+ static int has_vars(node *n)
+ {
+	 if (n->type == VAR)
+		 return 1;
+	 if (n->type == VAL)
+		 return 0;
+	 return has_vars(n->l) || has_vars(n->r);
+ }
+ 
+ /*
+  * Calcula el rango de *pn y pliega los subárboles constantes.
+  * Los que contenían variables se listan en `report` (si no es NULL),
+  * porque son los que un plegado de constantes normal no vería.
+  * Rangos y valores plegados son los del modo `ar`.
+  */
+ ivl interval_fold(node **pn, const ivl *vars, const arith *ar, FILE *report)
+ {
+	 node *n = *pn;
+	 node *folded;
+	 ivl a;
+	 ivl b;
+	 ivl r;
+	 
+	 if (n->type == VAL)
+		 return ivl_fit(ar, n->val, n->val);
+	 if (n->type == VAR)
+		 return ivl_fit(ar, vars[n->val].lo, vars[n->val].hi);
+	 a = interval_fold(&n->l, vars, ar, report);  // Izquierda primero: informe en orden
+	 b = interval_fold(&n->r, vars, ar, report);
+	 r = ivl_op(ar, n->type, a, b);
+	 if (r.lo != r.hi || !(folded = mk_val((int)r.lo)))
+		 return r;
+	 if (report && has_vars(n))
+	 {
+		 fprintf(report, "constant: ");
+		 print_tree(report, n, 0);
+		 fprintf(report, " = %lld\n", r.lo);
+	 }
+	 destroy_tree(n);
+	 *pn = folded;
+	 return r;
+ }
+ 
+ /*
+  * MODO --analyze:
+  * - vbc [--wrap|--sat|--mod p] --analyze '<expr>' x=0..3 y=5 ...
+  *   (variables no dadas: 0; en AR_MOD una variable vale su resto)
+  * - Lista los subárboles con variables que son constantes en esos
+  *   rangos, el rango del resultado y la expresión ya plegada
+  */
+ static int analyze_main(char *input, int argc, char **assign, const arith *a)
+ {
+	 ivl vars[26];
+	 node *tree;
+	 ivl r;
+	 int i;
+	 
+	 for (i = 0; i < 26; i++)
+		 vars[i] = ivl_clamp(0, 0);
+	 for (i = 0; i < argc; i++)
+	 {
+		 char *dots;
+		 
+		 if (!islower((unsigned char)assign[i][0]) || assign[i][1] != '=')
+			 return 1;
+		 vars[assign[i][0] - 'a'].lo = atoi(assign[i] + 2);
+		 dots = strstr(assign[i] + 2, "..");
+		 vars[assign[i][0] - 'a'].hi = dots ? atoi(dots + 2) : atoi(assign[i] + 2);
+		 if (vars[assign[i][0] - 'a'].lo > vars[assign[i][0] - 'a'].hi)
+			 return 1;
+	 }
+	 tree = parse_expression_vars(&input);
+	 if (!tree)
+		 return 1;
+	 r = interval_fold(&tree, vars, a, stdout);
+	 printf("range: [%lld, %lld]\n", r.lo, r.hi);
+	 printf("folded: ");
+	 print_tree(stdout, tree, 0);
+	 printf("\n");
+	 destroy_tree(tree);
+	 return 0;
+ }
+ 
+ /*
+  * MEDICIÓN DE TIEMPO:
+  * - Reloj monotónico en nanosegundos para los modos de benchmark
+  */
+ static long long now_ns(void)
+ {
+	 struct timespec ts;
+	 
+	 clock_gettime(CLOCK_MONOTONIC, &ts);
+	 return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+ }
+ 
+ static long count_nodes(node *n)
+ {
+	 if (!n)
+		 return 0;
+	 if (n->type == VAL)
+		 return 1;
+	 return 1 + count_nodes(n->l) + count_nodes(n->r);
+ }
+ 
+ /*
+  * GENERACIÓN DE CÓDIGO C (AHEAD-OF-TIME):
+  * - --emit-c: traduce el AST a una función C `int vbc_eval(void)`
+  * - --emit-so: la compila con el cc local y la carga con dlopen
+  * - Aritmética en unsigned: el desbordamiento queda definido (envuelve
+  *   igual que eval_tree en la práctica) y el compilador puede plegarlo todo
+  * - En AR_SAT / AR_MOD se emiten vbc_add() / vbc_mul() inline con la
+  *   semántica del modo; los literales ya van reducidos
+  * - Árboles grandes se parten en funciones de como máximo EMIT_CHUNK
+  *   nodos: acota el tiempo de compilación y la profundidad de anidado
+  */
+ #define EMIT_CHUNK 256
+ 
+ static void emit_expr(FILE *out, node *n, const arith *a)
+ {
+	 if (n->type == VAL)
+	 {
+		 if (a->mode == AR_SAT)
+			 fprintf(out, "%d", n->val);
+		 else
+			 fprintf(out, "%uu", (unsigned)ar_leaf(a, n->val));
+		 return;
+	 }
+	 if (n->val)  // Subárbol ya emitido como función propia
+	 {
+		 fprintf(out, "vbc_f%d()", n->val);
+		 return;
+	 }
+	 if (a->mode == AR_WRAP)
+	 {
+		 fputc('(', out);
+		 emit_expr(out, n->l, a);
+		 fputc(n->type == ADD ? '+' : '*', out);
+		 emit_expr(out, n->r, a);
+		 fputc(')', out);
+		 return;
+	 }
+	 fprintf(out, n->type == ADD ? "vbc_add(" : "vbc_mul(");
+	 emit_expr(out, n->l, a);
+	 fputc(',', out);
+	 emit_expr(out, n->r, a);
+	 fputc(')', out);
+ }
+ 
+ /*
+  * PARTICIÓN EN FUNCIONES:
+  * - Recorrido post-order que devuelve el "peso" pendiente de cada subárbol
+  * - Si un nodo supera EMIT_CHUNK, su hijo más pesado se emite como
+  *   función y pasa a pesar 1 (una llamada)
+  * - Post-order garantiza que cada función se define antes de usarse
+  * - El id de función se guarda en val (no usado en nodos operadores)
+  */
+ static int emit_split(FILE *out, node *n, int *next, const arith *a)
+ {
+	 int wl;
+	 int wr;
+	 int w;
+	 
+	 if (n->type == VAL)
+		 return 1;
+	 wl = emit_split(out, n->l, next, a);
+	 wr = emit_split(out, n->r, next, a);
+	 w = 1 + wl + wr;
+	 while (w > EMIT_CHUNK)
+	 {
+		 node *big = (wl >= wr) ? n->l : n->r;
+		 int *wbig = (wl >= wr) ? &wl : &wr;
+		 
+		 fprintf(out, "static vbc_t vbc_f%d(void)\n{\n\treturn ", ++*next);
+		 emit_expr(out, big, a);
+		 fprintf(out, ";\n}\n\n");
+		 big->val = *next;
+		 w -= *wbig - 1;
+		 *wbig = 1;
+	 }
+	 return w;
+ }
+ 
+ static void emit_clear(node *n)
+ {
+	 if (n->type == VAL)
+		 return;
+	 n->val = 0;
+	 emit_clear(n->l);
+	 emit_clear(n->r);
+ }
+ 
+ static void emit_prelude(FILE *out, const arith *a)
+ {
+	 if (a->mode == AR_WRAP)
+		 fprintf(out, "typedef unsigned vbc_t;\n\n");
+	 else if (a->mode == AR_SAT)
+		 fprintf(out, "typedef int vbc_t;\n\n"
+			 "static inline vbc_t vbc_sat(long long x)\n{\n"
+			 "\treturn x > %d ? %d : x < %d - 1 ? %d - 1 : (vbc_t)x;\n}\n\n"
+			 "static inline vbc_t vbc_add(vbc_t x, vbc_t y)\n{\n"
+			 "\treturn vbc_sat((long long)x + y);\n}\n\n"
+			 "static inline vbc_t vbc_mul(vbc_t x, vbc_t y)\n{\n"
+			 "\treturn vbc_sat((long long)x * y);\n}\n\n",
+			 INT_MAX, INT_MAX, -INT_MAX, -INT_MAX);
+	 else
+		 fprintf(out, "typedef unsigned vbc_t;\n\n"
+			 "static inline vbc_t vbc_add(vbc_t x, vbc_t y)\n{\n"
+			 "\treturn (vbc_t)(((unsigned long long)x + y) %% %uu);\n}\n\n"
+			 "static inline vbc_t vbc_mul(vbc_t x, vbc_t y)\n{\n"
+			 "\treturn (vbc_t)(((unsigned long long)x * y) %% %uu);\n}\n\n",
+			 a->p, a->p);
+ }
+ 
+ void emit_c_ar(FILE *out, node *tree, const arith *a)
+ {
+	 int next = 0;
+	 
+	 fprintf(out, "/* Generado por vbc --emit-c */\n\n");
+	 emit_prelude(out, a);
+	 emit_split(out, tree, &next, a);
+	 fprintf(out, "int vbc_eval(void)\n{\n\treturn (int)");
+	 emit_expr(out, tree, a);
+	 fprintf(out, ";\n}\n");
+	 emit_clear(tree);
+ }
+ 
+ void emit_c(FILE *out, node *tree)
+ {
+	 emit_c_ar(out, tree, &ar_wrap);
+ }
+ 
+ /*
+  * COMPILACIÓN A OBJETO COMPARTIDO:
+  * - Escribe el C en un fichero temporal
+  * - fork + execlp("cc") con -O2 -shared -fPIC
+  * - Devuelve 0 si el compilador terminó con éxito, -1 en otro caso
+  */
+ static int compile_so(node *tree, const char *so_path, const arith *a)
+ {
+	 char src[] = "/tmp/vbc_XXXXXX.c";
+	 FILE *out;
+	 pid_t pid;
+	 int status;
+	 int fd;
+	 
+	 fd = mkstemps(src, 2);
+	 if (fd == -1)
+		 return -1;
+	 out = fdopen(fd, "w");
+	 if (!out)
+	 {
+		 close(fd);
+		 unlink(src);
+		 return -1;
+	 }
+	 emit_c_ar(out, tree, a);
+	 fclose(out);
+	 
+	 pid = fork();
+	 if (pid == -1)
+	 {
+		 unlink(src);
+		 return -1;
+	 }
+	 if (pid == 0)
+	 {
+		 execlp("cc", "cc", "-O2", "-shared", "-fPIC", "-o", so_path, src,
+			 (char *)NULL);
+		 _exit(127);
+	 }
+	 if (waitpid(pid, &status, 0) == -1)
+		 status = -1;
+	 unlink(src);
+	 if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		 return -1;
+	 return 0;
+ }
+ 
+ /*
+  * MODO --emit-so:
+  * - Compila, carga con dlopen y llama a vbc_eval()
+  * - Imprime el resultado en stdout (igual que el modo normal)
+  * - En stderr, el tiempo de compilación y el de carga+primera llamada;
+  *   no se compara con eval_tree por llamada: sin entradas en tiempo de
+  *   ejecución cc pliega vbc_eval() a una constante
+  */
+ static int emit_so_main(const char *so_arg, char *input, const arith *a)
+ {
+	 char path[4096];
+	 int (*fn)(void);
+	 volatile int sink;
+	 long long t0;
+	 long long t_cc;
+	 long long t_load;
+	 void *h;
+	 node *tree;
+	 
+	 tree = parse_expression(&input);
+	 if (!tree)
+		 return 1;
+	 // dlopen solo trata la ruta como fichero si contiene '/'
+	 snprintf(path, sizeof(path), "%s%s", strchr(so_arg, '/') ? "" : "./", so_arg);
+	 t0 = now_ns();
+	 if (compile_so(tree, path, a) == -1)
+	 {
+		 destroy_tree(tree);
+		 return 1;
+	 }
+	 t_cc = now_ns() - t0;
+	 
+	 t0 = now_ns();
+	 h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	 fn = h ? (int (*)(void))dlsym(h, "vbc_eval") : NULL;
+	 if (!fn)
+	 {
+		 if (h)
+			 dlclose(h);
+		 destroy_tree(tree);
+		 return 1;
+	 }
+	 sink = fn();
+	 t_load = now_ns() - t0;
+	 printf("%d\n", sink);
+	 fprintf(stderr, "compile: %.1f ms | load+call: %lld ns\n",
+		 t_cc / 1e6, t_load);
+	 
+	 dlclose(h);
+	 destroy_tree(tree);
+	 return 0;
+ }
+ 
+ static int emit_c_main(char *input, const arith *a)
+ {
+	 node *tree = parse_expression(&input);
+	 
+	 if (!tree)
+		 return 1;
+	 emit_c_ar(stdout, tree, a);
+	 destroy_tree(tree);
+	 return 0;
+ }
+ 
+ /*
+  * EVALUACIÓN INCREMENTAL:
+  * - Copia aplanada del AST (post-order) con valor cacheado por nodo,
+  *   índice del padre y flag dirty
+  * - inc_set(): cambia un literal y marca sucio el camino hasta la raíz
+  * - inc_eval(): recalcula solo los nodos sucios → O(profundidad)
+  *   en lugar de O(tamaño) como eval_tree
+  * - Invariante: si un nodo está sucio, todos sus ancestros también,
+  *   así inc_set() puede parar en el primer ancestro ya sucio
+  */
+ typedef struct inc_node {
+	 int val;              // Valor cacheado (o literal en hojas)
+	 int l;                // Índice del hijo izquierdo (-1 en hojas)
+	 int r;                // Índice del hijo derecho (-1 en hojas)
+	 int parent;           // Índice del padre (-1 en la raíz)
+	 unsigned char type;   // ADD, MULTI o VAL
+	 unsigned char dirty;  // 1 si val está desactualizado
+ } inc_node;
+ 
+ typedef struct inc_tree {
+	 inc_node *n;     // Nodos en post-order: la raíz es el último
+	 int *leaf;       // Índice de cada literal, de izquierda a derecha
+	 int size;
+	 int nleaf;
+	 arith ar;        // Semántica aritmética (AR_WRAP por defecto)
+ } inc_tree;
+ 
+ static int inc_fill(inc_tree *t, node *n)
+ {
+	 int i;
+	 int l = -1;
+	 int r = -1;
+	 
+	 if (n->type != VAL)
+	 {
+		 l = inc_fill(t, n->l);
+		 r = inc_fill(t, n->r);
+	 }
+	 i = t->size++;
+	 t->n[i].type = n->type;
+	 t->n[i].val = (n->type == VAL) ? n->val : 0;
+	 t->n[i].l = l;
+	 t->n[i].r = r;
+	 t->n[i].parent = -1;
+	 t->n[i].dirty = (n->type != VAL);
+	 if (n->type == VAL)
+		 t->leaf[t->nleaf++] = i;
+	 else
+	 {
+		 t->n[l].parent = i;
+		 t->n[r].parent = i;
+	 }
+	 return i;
+ }
+ 
+ int inc_build(inc_tree *t, node *tree)
+ {
+	 long size = count_nodes(tree);
+	 
+	 t->size = 0;
+	 t->nleaf = 0;
+	 t->ar = ar_wrap;
+	 t->n = malloc(size * sizeof(*t->n));
+	 t->leaf = malloc((size / 2 + 1) * sizeof(*t->leaf));
+	 if (!t->n || !t->leaf)
+	 {
+		 free(t->n);
+		 free(t->leaf);
+		 return -1;
+	 }
+	 inc_fill(t, tree);
+	 return 0;
+ }
+ 
+ void inc_free(inc_tree *t)
+ {
+	 free(t->n);
+	 free(t->leaf);
+ }
+ 
+ void inc_set(inc_tree *t, int leaf, int val)
+ {
+	 int i = t->leaf[leaf];
+	 
+	 t->n[i].val = val;
+	 i = t->n[i].parent;
+	 while (i != -1 && !t->n[i].dirty)
+	 {
+		 t->n[i].dirty = 1;
+		 i = t->n[i].parent;
+	 }
+ }
+ 
+ static int inc_fix(const arith *a, inc_node *n, int i)
+ {
+	 int l;
+	 int r;
+	 
+	 if (n[i].type == VAL)
+		 return ar_leaf(a, n[i].val);
+	 if (!n[i].dirty)
+		 return n[i].val;
+	 l = inc_fix(a, n, n[i].l);
+	 r = inc_fix(a, n, n[i].r);
+	 n[i].val = ar_op(a, n[i].type, l, r);
+	 n[i].dirty = 0;
+	 return n[i].val;
+ }
+ 
+ int inc_eval(inc_tree *t)
+ {
+	 return inc_fix(&t->ar, t->n, t->size - 1);
+ }
+ 
+ /*
+  * MODO --incr:
+  * - Parsea la expresión e imprime su valor
+  * - Lee de stdin líneas "<literal> <valor>" (literal = índice 0-based,
+  *   de izquierda a derecha) e imprime el nuevo resultado tras cada cambio
+  */
+ static int incr_main(char *input, const arith *a)
+ {
+	 inc_tree t;
+	 node *tree;
+	 int leaf;
+	 int val;
+	 
+	 tree = parse_expression(&input);
+	 if (!tree)
+		 return 1;
+	 if (inc_build(&t, tree) == -1)
+	 {
+		 destroy_tree(tree);
+		 return 1;
+	 }
+	 destroy_tree(tree);
+	 t.ar = *a;
+	 printf("%d\n", inc_eval(&t));
+	 while (scanf("%d %d", &leaf, &val) == 2)
+	 {
+		 if (leaf < 0 || leaf >= t.nleaf)
+		 {
+			 fprintf(stderr, "vbc: literal %d out of range\n", leaf);
+			 continue;
+		 }
+		 inc_set(&t, leaf, val);
+		 printf("%d\n", inc_eval(&t));
+	 }
+	 inc_free(&t);
+	 return 0;
+ }
+ 
+ /*
+  * REPRESENTACIÓN PLANA (STRUCTURE OF ARRAYS):
+  * - El AST se copia a arrays paralelos en post-order:
+  *   op[i], val[i], l[i], r[i]
+  * - Los hijos siempre tienen índice menor que el padre, así que la
+  *   evaluación es un recorrido lineal hacia delante, sin recursión
+  *   ni punteros: el prefetcher ve un acceso secuencial
+  * - Un solo bloque de memoria para todos los arrays
+  */
+ typedef struct flat {
+	 unsigned char *op;  // ADD, MULTI o VAL
+	 int *val;           // Literal (solo VAL)
+	 int *l;             // Índice del hijo izquierdo (solo operadores)
+	 int *r;             // Índice del hijo derecho (solo operadores)
+	 int n;              // Número de nodos; la raíz es n - 1
+ } flat;
+ 
+ static int flat_fill(flat *f, node *n)
+ {
+	 int l = 0;
+	 int r = 0;
+	 int i;
+	 
+	 if (n->type != VAL)
+	 {
+		 l = flat_fill(f, n->l);
+		 r = flat_fill(f, n->r);
+	 }
+	 i = f->n++;
+	 f->op[i] = n->type;
+	 f->val[i] = (n->type == VAL) ? n->val : 0;
+	 f->l[i] = l;
+	 f->r[i] = r;
+	 return i;
+ }
+ 
+ int flat_build(flat *f, node *tree)
+ {
+	 long size = count_nodes(tree);
+	 char *mem;
+	 
+	 // Los arrays de int van primero para mantener su alineación
+	 mem = malloc(size * (3 * sizeof(int) + 1));
+	 if (!mem)
+		 return -1;
+	 f->val = (int *)mem;
+	 f->l = f->val + size;
+	 f->r = f->l + size;
+	 f->op = (unsigned char *)(f->r + size);
+	 f->n = 0;
+	 flat_fill(f, tree);
+	 return 0;
+ }
+ 
+ void flat_free(flat *f)
+ {
+	 free(f->val);
+ }
+ 
+ /*
+  * EVALUACIÓN LINEAL:
+  * - scratch: array de f->n enteros proporcionado por el llamador
+  *   (reutilizable entre evaluaciones)
+  */
+ int eval_flat(const flat *f, int *scratch)
+ {
+	 unsigned *v = (unsigned *)scratch;
+	 int i;
+	 
+	 for (i = 0; i < f->n; i++)
+	 {
+		 if (f->op[i] == VAL)
+			 v[i] = f->val[i];
+		 else if (f->op[i] == ADD)
+			 v[i] = v[f->l[i]] + v[f->r[i]];
+		 else
+			 v[i] = v[f->l[i]] * v[f->r[i]];
+	 }
+	 return (int)v[f->n - 1];
+ }
+ 
+ int eval_flat_ar(const flat *f, const arith *a, int *scratch)
+ {
+	 int i;
+	 
+	 for (i = 0; i < f->n; i++)
+	 {
+		 if (f->op[i] == VAL)
+			 scratch[i] = ar_leaf(a, f->val[i]);
+		 else
+			 scratch[i] = ar_op(a, f->op[i], scratch[f->l[i]], scratch[f->r[i]]);
+	 }
+	 return scratch[f->n - 1];
+ }
+ 
+ /*
+  * EVALUACIÓN POR LOTES:
+  * - Misma expresión evaluada sobre `lanes` asignaciones distintas
+  *   de sus literales: leaf_in[k] es el array de valores del literal k
+  *   (de izquierda a derecha), o NULL para usar el literal original
+  * - Se recorre el programa plano una vez por bloque de BATCH_BLOCK
+  *   carriles con una pila de filas: en post-order los operandos de
+  *   cada operador son siempre las dos filas superiores
+  * - Cada operador es un bucle simple sobre la fila (vec_add/vec_mul)
+  *   que el compilador vectoriza con -O3
+  * - En AR_MOD las filas están en forma de Montgomery (x·2^32 mod p):
+  *   se convierte al cargar cada literal y al escribir el resultado
+  */
+ #define BATCH_BLOCK 256
+ 
+ static inline unsigned mont_mul(const arith *a, unsigned x, unsigned y)
+ {
+	 unsigned long long t = (unsigned long long)x * y;
+	 unsigned m = (unsigned)t * a->pinv;
+	 unsigned long long u = (t + (unsigned long long)m * a->p) >> 32;
+	 
+	 return (unsigned)(u >= a->p ? u - a->p : u);
+ }
+ 
+ static void vec_add(const arith *a, unsigned *restrict x,
+	 const unsigned *restrict y, int n)
+ {
+	 int i;
+	 
+	 if (a->mode == AR_WRAP)
+		 for (i = 0; i < n; i++)
+			 x[i] += y[i];
+	 else if (a->mode == AR_SAT)
+		 for (i = 0; i < n; i++)
+			 x[i] = (unsigned)sat((long long)(int)x[i] + (int)y[i]);
+	 else
+		 for (i = 0; i < n; i++)
+		 {
+			 unsigned s = x[i] + y[i];
+			 
+			 x[i] = s >= a->p ? s - a->p : s;
+		 }
+ }
+ 
+ static void vec_mul(const arith *a, unsigned *restrict x,
+	 const unsigned *restrict y, int n)
+ {
+	 int i;
+	 
+	 if (a->mode == AR_WRAP)
+		 for (i = 0; i < n; i++)
+			 x[i] *= y[i];
+	 else if (a->mode == AR_SAT)
+		 for (i = 0; i < n; i++)
+			 x[i] = (unsigned)sat((long long)(int)x[i] * (int)y[i]);
+	 else
+		 for (i = 0; i < n; i++)
+			 x[i] = mont_mul(a, x[i], y[i]);
+ }
+ 
+ /*
+  * Carga de literales: en AR_MOD se pasa directamente a Montgomery sin
+  * reducir antes (mont_mul admite x < 2^32); un valor negativo se leyó
+  * como v + 2^32, así que se resta la forma de Montgomery de 2^32
+  * (2^32 · 2^32 mod p = r2)
+  */
+ static void vec_load(const arith *a, unsigned *restrict x,
+	 const int *in, int lit, int n)
+ {
+	 int i;
+	 
+	 for (i = 0; i < n; i++)
+		 x[i] = (unsigned)(in ? in[i] : lit);
+	 if (a->mode != AR_MOD)
+		 return;
+	 for (i = 0; i < n; i++)
+	 {
+		 unsigned m = mont_mul(a, x[i], a->r2);
+		 unsigned neg = ((int)x[i] < 0) ? a->r2 : 0;
+		 
+		 x[i] = m >= neg ? m - neg : m + a->p - neg;
+	 }
+ }
+ 
+ // Profundidad máxima de la pila de evaluación del programa plano
+ static int flat_stack_depth(const flat *f)
+ {
+	 int depth = 0;
+	 int max = 0;
+	 int i;
+	 
+	 for (i = 0; i < f->n; i++)
+	 {
+		 depth += (f->op[i] == VAL) ? 1 : -1;
+		 if (depth > max)
+			 max = depth;
+	 }
+	 return max;
+ }
+ 
+ int eval_flat_batch(const flat *f, const arith *a, const int *const *leaf_in,
+	 int *out, int lanes)
+ {
+	 unsigned *stack;
+	 int base;
+	 int n;
+	 int i;
+	 int k;
+	 int sp;
+	 
+	 stack = malloc((size_t)flat_stack_depth(f) * BATCH_BLOCK * sizeof(unsigned));
+	 if (!stack)
+		 return -1;
+	 for (base = 0; base < lanes; base += BATCH_BLOCK)
+	 {
+		 n = lanes - base < BATCH_BLOCK ? lanes - base : BATCH_BLOCK;
+		 sp = 0;
+		 k = 0;
+		 for (i = 0; i < f->n; i++)
+		 {
+			 unsigned *top = stack + (size_t)sp * BATCH_BLOCK;
+			 
+			 if (f->op[i] == VAL)
+			 {
+				 vec_load(a, top, leaf_in && leaf_in[k] ? leaf_in[k] + base
+					 : NULL, f->val[i], n);
+				 k++;
+				 sp++;
+				 continue;
+			 }
+			 sp--;
+			 if (f->op[i] == ADD)
+				 vec_add(a, top - 2 * BATCH_BLOCK, top - BATCH_BLOCK, n);
+			 else
+				 vec_mul(a, top - 2 * BATCH_BLOCK, top - BATCH_BLOCK, n);
+		 }
+		 for (i = 0; i < n; i++)
+			 out[base + i] = (int)(a->mode == AR_MOD
+				 ? mont_mul(a, stack[i], 1) : stack[i]);
+	 }
+	 free(stack);
+	 return 0;
+ }
+ 
+ static int flat_main(char *input, const arith *a)
+ {
+	 node *tree;
+	 int *scratch;
+	 flat f;
+	 
+	 tree = parse_expression(&input);
+	 if (!tree)
+		 return 1;
+	 if (flat_build(&f, tree) == -1)
+	 {
+		 destroy_tree(tree);
+		 return 1;
+	 }
+	 destroy_tree(tree);
+	 scratch = malloc(f.n * sizeof(int));
+	 if (!scratch)
+	 {
+		 flat_free(&f);
+		 return 1;
+	 }
+	 printf("%d\n", eval_flat_ar(&f, a, scratch));
+	 free(scratch);
+	 flat_free(&f);
+	 return 0;
+ }
+ 
+ /*
+  * EVALUACIÓN EN STREAMING (--stream):
+  * - Para expresiones que no caben en memoria: se leen por bloques
+  *   con read() y se evalúan sin construir el AST
+  * - Memoria proporcional a la profundidad de paréntesis, no a la
+  *   longitud: una pila de niveles, cada uno con la suma acumulada y
+  *   el producto en curso (la precedencia de * sobre + sale sola:
+  *   '*' multiplica el producto, '+' lo vuelca en la suma)
+  * - Las operaciones se aplican en el mismo orden que el árbol
+  *   asociativo por la izquierda, así que el resultado coincide con
+  *   eval_tree / eval_tree_ar también en modo saturado
+  * - Los errores son exactamente los de unexpected(), en el mismo
+  *   carácter en que los detectaría el parser recursivo:
+  *     esperando operando: '(' abre nivel, dígito es valor, resto error
+  *     tras operando: '*', '+', ')' con nivel abierto, fin sin niveles
+  * - Como en el parser recursivo, cada paréntesis abierto que se deshace
+  *   por un error vuelve a imprimirlo (ver stream_fail)
+  * - Un único '\n' final se trata como fin de entrada (ficheros de texto)
+  */
+ #define STREAM_CHUNK 65536
+ 
+ typedef struct stream_level {
+	 int sum;    // Suma de los términos ya cerrados
+	 int prod;   // Producto del término en curso
+ } stream_level;
+ 
+ typedef struct stream {
+	 stream_level *lv;
+	 size_t depth;        // Niveles abiertos por '(' (lv[0] es el global)
+	 size_t cap;
+	 int after_operand;   // 0: se espera operando, 1: se espera operador
+	 int pending_nl;      // Se vio '\n': solo es válido si es el último byte
+	 const arith *ar;
+ } stream;
+ 
+ static void stream_value(stream *st, int v)
+ {
+	 stream_level *top = &st->lv[st->depth];
+	 
+	 top->prod = ar_op(st->ar, MULTI, top->prod, v);
+	 st->after_operand = 1;
+ }
+ 
+ static int stream_push(stream *st)
+ {
+	 if (st->depth + 1 == st->cap)
+	 {
+		 stream_level *grown = realloc(st->lv, 2 * st->cap * sizeof(*grown));
+		 
+		 if (!grown)
+			 return -1;
+		 st->lv = grown;
+		 st->cap *= 2;
+	 }
+	 st->depth++;
+	 st->lv[st->depth].sum = ar_leaf(st->ar, 0);
+	 st->lv[st->depth].prod = ar_leaf(st->ar, 1);
+	 return 0;
+ }
+ 
+ /*
+  * Reproduce las líneas que imprimiría el parser recursivo: el error
+  * sale una vez donde se detecta y otra por cada parse_primary con
+  * paréntesis que se desapila (su `if (!res || **s != ')')` vuelve a
+  * llamar a unexpected). Si se esperaba operador dentro de un
+  * paréntesis, el propio cierre es quien lo detecta.
+  */
+ static int stream_fail(stream *st, char c)
+ {
+	 size_t times;
+	 
+	 if (!st->after_operand)
+		 times = 1 + st->depth;
+	 else
+		 times = st->depth ? st->depth : 1;
+	 while (times--)
+		 unexpected(c);
+	 return -1;
+ }
+ 
+ // Procesa un carácter; devuelve -1 tras imprimir el error
+ static int stream_char(stream *st, char c)
+ {
+	 stream_level *top = &st->lv[st->depth];
+	 
+	 if (st->pending_nl)
+		 return stream_fail(st, '\n');
+	 if (c == '\n')
+	 {
+		 st->pending_nl = 1;
+		 return 0;
+	 }
+	 if (!st->after_operand)
+	 {
+		 if (c == '(')
+			 return stream_push(st);
+		 if (isdigit((unsigned char)c))
+		 {
+			 stream_value(st, ar_leaf(st->ar, c - '0'));
+			 return 0;
+		 }
+	 }
+	 else if (c == '*')
+	 {
+		 st->after_operand = 0;
+		 return 0;
+	 }
+	 else if (c == '+')
+	 {
+		 top->sum = ar_op(st->ar, ADD, top->sum, top->prod);
+		 top->prod = ar_leaf(st->ar, 1);
+		 st->after_operand = 0;
+		 return 0;
+	 }
+	 else if (c == ')' && st->depth > 0)
+	 {
+		 st->depth--;
+		 stream_value(st, ar_op(st->ar, ADD, top->sum, top->prod));
+		 return 0;
+	 }
+	 return stream_fail(st, c);
+ }
+ 
+ static int stream_main(const char *path, const arith *a)
+ {
+	 char *buf;
+	 stream st;
+	 ssize_t n;
+	 ssize_t i;
+	 int fd = 0;
+	 int err = 0;
+	 
+	 if (path && strcmp(path, "-") && (fd = open(path, O_RDONLY)) == -1)
+		 return 1;
+	 buf = malloc(STREAM_CHUNK);
+	 st.cap = 64;
+	 st.lv = malloc(st.cap * sizeof(*st.lv));
+	 if (!buf || !st.lv)
+		 err = 1;
+	 st.depth = 0;
+	 st.after_operand = 0;
+	 st.pending_nl = 0;
+	 st.ar = a;
+	 if (!err)
+	 {
+		 st.lv[0].sum = ar_leaf(a, 0);
+		 st.lv[0].prod = ar_leaf(a, 1);
+	 }
+	 while (!err && (n = read(fd, buf, STREAM_CHUNK)) != 0)
+	 {
+		 if (n == -1)
+		 {
+			 err = 1;
+			 break;
+		 }
+		 for (i = 0; i < n && !err; i++)
+			 if (stream_char(&st, buf[i]) == -1)
+				 err = 1;
+	 }
+	 if (!err)
+	 {
+		 if (st.after_operand && st.depth == 0)
+			 printf("%d\n", ar_op(a, ADD, st.lv[0].sum, st.lv[0].prod));
+		 else
+			 err = -stream_fail(&st, '\0');
+	 }
+	 free(buf);
+	 free(st.lv);
+	 if (fd > 0)
+		 close(fd);
+	 return err;
+ }
+ 
+ /*
+  * FICHERO DE EXPRESIONES COMPILADAS (--db-build / --db):
+  * - Un solo fichero con todas las expresiones ya aplanadas, pensado
+  *   para mapearse con mmap al arrancar en lugar de reparsear
+  * - Estructura:
+  *     cabecera | índice (ordenado por hash, nombre) | nombres | programas
+  * - Cada programa tiene exactamente la disposición de flat_build()
+  *   (val[n], l[n], r[n], op[n]) alineada a 8 bytes, así que un flat
+  *   puede apuntar directamente al mapa: las búsquedas no copian nada
+  * - Las búsquedas son una búsqueda binaria sobre el hash FNV-1a del
+  *   nombre; desplazamientos y programa se validan al buscar, no al
+  *   abrir, para que abrir sea O(1) con independencia del número de
+  *   entradas: cada op es ADD, MULTI o VAL, cada hijo apunta a un nodo
+  *   anterior y la pila del orden post-order (eval_flat_batch) cuadra,
+  *   así que ni un fichero corrupto hace leer fuera del programa
+  * - Enteros en el orden de bytes de la máquina que lo genera
+  */
+ #define DB_MAGIC "VBCDB001"
+ 
+ typedef struct db_header {
+	 char magic[8];
+	 uint32_t count;       // Número de entradas del índice
+	 uint32_t max_nodes;   // Mayor programa (tamaño del scratch)
+	 uint64_t index_off;
+	 uint64_t size;        // Tamaño total esperado del fichero
+ } db_header;
+ 
+ typedef struct db_entry {
+	 uint64_t hash;
+	 uint64_t name_off;
+	 uint64_t prog_off;
+	 uint32_t name_len;
+	 uint32_t nodes;
+ } db_entry;
+ 
+ typedef struct vbc_db {
+	 const unsigned char *base;
+	 size_t size;
+	 const db_header *hdr;
+	 const db_entry *idx;
+ } vbc_db;
+ 
+ static uint64_t fnv1a(const char *s, size_t len)
+ {
+	 uint64_t h = 14695981039346656037ULL;
+	 size_t i;
+	 
+	 for (i = 0; i < len; i++)
+	 {
+		 h ^= (unsigned char)s[i];
+		 h *= 1099511628211ULL;
+	 }
+	 return h;
+ }
+ 
+ static size_t db_prog_size(uint32_t nodes)
+ {
+	 return ((size_t)nodes * (3 * sizeof(int) + 1) + 7) & ~(size_t)7;
+ }
+ 
+ int db_open(vbc_db *db, const char *path)
+ {
+	 struct stat st;
+	 void *map;
+	 int fd;
+	 
+	 fd = open(path, O_RDONLY);
+	 if (fd == -1)
+		 return -1;
+	 if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(db_header))
+	 {
+		 close(fd);
+		 return -1;
+	 }
+	 map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	 close(fd);
+	 if (map == MAP_FAILED)
+		 return -1;
+	 db->base = map;
+	 db->size = st.st_size;
+	 db->hdr = map;
+	 db->idx = (const db_entry *)(db->base + db->hdr->index_off);
+	 if (memcmp(db->hdr->magic, DB_MAGIC, 8) || db->hdr->size != db->size
+		 || db->hdr->index_off > db->size || (db->hdr->index_off & 7)
+		 || (db->size - db->hdr->index_off) / sizeof(db_entry) < db->hdr->count)
+	 {
+		 munmap(map, st.st_size);
+		 return -1;
+	 }
+	 return 0;
+ }
+ 
+ void db_close(vbc_db *db)
+ {
+	 munmap((void *)db->base, db->size);
+ }
+ 
+ static int db_entry_cmp(uint64_t hash, const char *name, size_t len,
+	 const vbc_db *db, const db_entry *e)
+ {
+	 int c;
+	 
+	 if (hash != e->hash)
+		 return hash < e->hash ? -1 : 1;
+	 c = memcmp(name, db->base + e->name_off, len < e->name_len ? len : e->name_len);
+	 if (c)
+		 return c;
+	 return (len > e->name_len) - (len < e->name_len);
+ }
+ 
+ // Un programa leído del fichero: hijos anteriores al nodo y pila coherente
+ static int db_prog_ok(const flat *f)
+ {
+	 int depth = 0;
+	 int i;
+	 
+	 for (i = 0; i < f->n; i++)
+	 {
+		 if (f->op[i] == VAL)
+		 {
+			 depth++;
+			 continue;
+		 }
+		 if ((f->op[i] != ADD && f->op[i] != MULTI) || depth < 2
+			 || f->l[i] < 0 || f->l[i] >= i || f->r[i] < 0 || f->r[i] >= i)
+			 return 0;
+		 depth--;
+	 }
+	 return depth == 1;
+ }
+ 
+ /*
+  * Busca `name` y deja en *f un programa que apunta dentro del mapa
+  * (no llamar a flat_free sobre él). Devuelve -1 si no existe, si la
+  * entrada apunta fuera del fichero o si el programa no es válido.
+  */
+ int db_find(const vbc_db *db, const char *name, flat *f)
+ {
+	 size_t len = strlen(name);
+	 uint64_t hash = fnv1a(name, len);
+	 const db_entry *e;
+	 size_t lo = 0;
+	 size_t hi = db->hdr->count;
+	 size_t mid;
+	 int c;
+	 
+	 while (lo < hi)
+	 {
+		 mid = lo + (hi - lo) / 2;
+		 e = &db->idx[mid];
+		 if (e->name_off > db->size || e->name_len > db->size - e->name_off)
+			 return -1;
+		 c = db_entry_cmp(hash, name, len, db, e);
+		 if (!c)
+		 {
+			 if (!e->nodes || e->nodes > db->hdr->max_nodes
+				 || e->prog_off > db->size || (e->prog_off & 7)
+				 || db_prog_size(e->nodes) > db->size - e->prog_off)
+				 return -1;
+			 f->n = e->nodes;
+			 f->val = (int *)(db->base + e->prog_off);
+			 f->l = f->val + f->n;
+			 f->r = f->l + f->n;
+			 f->op = (unsigned char *)(f->r + f->n);
+			 return db_prog_ok(f) ? 0 : -1;
+		 }
+		 if (c < 0)
+			 hi = mid;
+		 else
+			 lo = mid + 1;
+	 }
+	 return -1;
+ }
+ 
+ /*
+  * CONSTRUCCIÓN DEL FICHERO:
+  * - Entrada: una línea "nombre=expresión" por fórmula
+  * - Cualquier error de parseo aborta la construcción: se imprime el
+  *   mensaje habitual de unexpected() y el número de línea en stderr
+  * - Se escribe en "<out>.tmp" y se renombra: los lectores nunca ven
+  *   un fichero a medias
+  */
+ typedef struct db_build_item {
+	 db_entry e;
+	 char *name;
+	 flat f;
+ } db_build_item;
+ 
+ static int db_item_cmp(const void *pa, const void *pb)
+ {
+	 const db_build_item *a = pa;
+	 const db_build_item *b = pb;
+	 size_t len = a->e.name_len < b->e.name_len ? a->e.name_len : b->e.name_len;
+	 int c;
+	 
+	 if (a->e.hash != b->e.hash)
+		 return a->e.hash < b->e.hash ? -1 : 1;
+	 c = memcmp(a->name, b->name, len);
+	 if (c)
+		 return c;
+	 return (a->e.name_len > b->e.name_len) - (a->e.name_len < b->e.name_len);
+ }
+ 
+ static int db_write(const char *path, db_build_item *items, uint32_t count)
+ {
+	 static const char pad[8];
+	 char tmp[4096];
+	 db_header h;
+	 uint64_t off;
+	 uint32_t i;
+	 FILE *out;
+	 int err = 0;
+	 
+	 memset(&h, 0, sizeof(h));
+	 memcpy(h.magic, DB_MAGIC, 8);
+	 h.count = count;
+	 h.index_off = sizeof(h);
+	 off = h.index_off + (uint64_t)count * sizeof(db_entry);
+	 for (i = 0; i < count; i++)
+	 {
+		 items[i].e.name_off = off;
+		 off += items[i].e.name_len;
+	 }
+	 off = (off + 7) & ~7ULL;
+	 for (i = 0; i < count; i++)
+	 {
+		 items[i].e.prog_off = off;
+		 off += db_prog_size(items[i].e.nodes);
+		 if (items[i].e.nodes > h.max_nodes)
+			 h.max_nodes = items[i].e.nodes;
+	 }
+	 h.size = off;
+	 
+	 snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	 out = fopen(tmp, "wb");
+	 if (!out)
+		 return -1;
+	 fwrite(&h, sizeof(h), 1, out);
+	 for (i = 0; i < count; i++)
+		 fwrite(&items[i].e, sizeof(db_entry), 1, out);
+	 for (i = 0; i < count; i++)
+		 fwrite(items[i].name, 1, items[i].e.name_len, out);
+	 fwrite(pad, 1, items[0].e.prog_off - ftell(out), out);
+	 for (i = 0; i < count; i++)
+	 {
+		 size_t n = items[i].f.n;
+		 size_t raw = n * (3 * sizeof(int) + 1);
+		 
+		 fwrite(items[i].f.val, sizeof(int), n, out);
+		 fwrite(items[i].f.l, sizeof(int), n, out);
+		 fwrite(items[i].f.r, sizeof(int), n, out);
+		 fwrite(items[i].f.op, 1, n, out);
+		 fwrite(pad, 1, db_prog_size(n) - raw, out);
+	 }
+	 if (ferror(out))
+		 err = -1;
+	 if (fclose(out) == EOF)
+		 err = -1;
+	 if (!err && rename(tmp, path) == -1)
+		 err = -1;
+	 if (err)
+		 unlink(tmp);
+	 return err;
+ }
+ 
+ static int db_build_main(const char *out_path, const char *list_path)
+ {
+	 db_build_item *items = NULL;
+	 size_t count = 0;
+	 size_t cap = 0;
+	 FILE *in = stdin;
+	 char *line = NULL;
+	 size_t line_cap = 0;
+	 ssize_t len;
+	 long lineno = 0;
+	 int err = 0;
+	 size_t i;
+	 
+	 if (list_path && !(in = fopen(list_path, "r")))
+		 return 1;
+	 while (!err && (len = getline(&line, &line_cap, in)) != -1)
+	 {
+		 char *eq;
+		 char *s;
+		 node *tree;
+		 
+		 lineno++;
+		 if (len > 0 && line[len - 1] == '\n')
+			 line[--len] = '\0';
+		 if (!len)
+			 continue;
+		 eq = strchr(line, '=');
+		 if (!eq || eq == line)
+		 {
+			 fprintf(stderr, "vbc: line %ld: expected name=expression\n", lineno);
+			 err = 1;
+			 break;
+		 }
+		 if (count == cap)
+		 {
+			 db_build_item *grown;
+			 
+			 cap = cap ? 2 * cap : 1024;
+			 grown = realloc(items, cap * sizeof(*items));
+			 if (!grown)
+			 {
+				 err = 1;
+				 break;
+			 }
+			 items = grown;
+		 }
+		 s = eq + 1;
+		 tree = parse_expression(&s);
+		 if (!tree)
+		 {
+			 fprintf(stderr, "vbc: line %ld: invalid expression\n", lineno);
+			 err = 1;
+			 break;
+		 }
+		 memset(&items[count], 0, sizeof(items[count]));
+		 items[count].e.name_len = eq - line;
+		 items[count].name = strndup(line, eq - line);
+		 if (!items[count].name || flat_build(&items[count].f, tree) == -1)
+		 {
+			 free(items[count].name);
+			 destroy_tree(tree);
+			 err = 1;
+			 break;
+		 }
+		 destroy_tree(tree);
+		 items[count].e.hash = fnv1a(line, eq - line);
+		 items[count].e.nodes = items[count].f.n;
+		 count++;
+	 }
+	 free(line);
+	 if (in != stdin)
+		 fclose(in);
+	 if (!err && count)
+	 {
+		 qsort(items, count, sizeof(*items), db_item_cmp);
+		 for (i = 1; i < count && !err; i++)
+			 if (!db_item_cmp(&items[i - 1], &items[i]))
+			 {
+				 fprintf(stderr, "vbc: duplicate name '%s'\n", items[i].name);
+				 err = 1;
+			 }
+		 if (!err && db_write(out_path, items, count) == -1)
+			 err = 1;
+	 }
+	 for (i = 0; i < count; i++)
+	 {
+		 free(items[i].name);
+		 flat_free(&items[i].f);
+	 }
+	 free(items);
+	 return err || !count;
+ }
+ 
+ /*
+  * MODO --db:
+  * - Abre el fichero, busca cada nombre pedido y lo evalúa desde el mapa
+  */
+ static int db_main(const char *path, int argc, char **names, const arith *a)
+ {
+	 int *scratch;
+	 vbc_db db;
+	 flat f;
+	 int err = 0;
+	 int i;
+	 
+	 if (db_open(&db, path) == -1)
+		 return 1;
+	 scratch = malloc((db.hdr->max_nodes + 1) * sizeof(int));
+	 if (!scratch)
+	 {
+		 db_close(&db);
+		 return 1;
+	 }
+	 for (i = 0; i < argc; i++)
+	 {
+		 if (db_find(&db, names[i], &f) == -1)
+		 {
+			 fprintf(stderr, "vbc: %s: not found or invalid\n", names[i]);
+			 err = 1;
+			 continue;
+		 }
+		 printf("%d\n", eval_flat_ar(&f, a, scratch));
+	 }
+	 free(scratch);
+	 db_close(&db);
+	 return err;
+ }
+ 
+ #ifdef VBC_BENCH
+ /*
+  * BENCHMARKS (compilar con -DVBC_BENCH -pthread):
+  * - Generador pseudoaleatorio con semilla para que los árboles
+  *   sean reproducibles entre ejecuciones
+  */
+ static unsigned long long bench_seed = 42;
+ 
+ static unsigned bench_rand(void)
+ {
+	 // xorshift64*
+	 bench_seed ^= bench_seed >> 12;
+	 bench_seed ^= bench_seed << 25;
+	 bench_seed ^= bench_seed >> 27;
+	 return (unsigned)((bench_seed * 2685821657736338717ULL) >> 32);
+ }
+ 
+ static node *bench_op(int type, node *l, node *r)
+ {
+	 node tmp;
+	 
+	 tmp.type = type;
+	 tmp.val = 0;
+	 tmp.l = l;
+	 tmp.r = r;
+	 return new_node(tmp);
+ }
+ 
+ static node *bench_leaf(void)
+ {
+	 node tmp;
+	 
+	 tmp.type = VAL;
+	 tmp.val = bench_rand() % 10;
+	 tmp.l = NULL;
+	 tmp.r = NULL;
+	 return new_node(tmp);
+ }
+ 
+ // Árbol balanceado con nleaf hojas y operadores aleatorios
+ static node *bench_balanced(long nleaf)
+ {
+	 node *l;
+	 
+	 if (nleaf <= 1)
+		 return bench_leaf();
+	 l = bench_balanced(nleaf / 2);
+	 return bench_op(bench_rand() % 2 ? ADD : MULTI, l,
+		 bench_balanced(nleaf - nleaf / 2));
+ }
+ 
+ /*
+  * Árbol desbalanceado: espina izquierda de profundidad `spine` con un
+  * subárbol balanceado de `side` hojas colgando a la derecha de cada nodo.
+  * La espina se construye iterativamente para no agotar la pila.
+  */
+ static node *bench_comb(long spine, long side)
+ {
+	 node *t = bench_balanced(side);
+	 long i;
+	 
+	 for (i = 1; i < spine; i++)
+		 t = bench_op(bench_rand() % 2 ? ADD : MULTI, t, bench_balanced(side));
+	 return t;
+ }
+ 
+ static void collect_leaves(node *n, node **out, long *k)
+ {
+	 if (n->type == VAL)
+	 {
+		 out[(*k)++] = n;
+		 return;
+	 }
+	 collect_leaves(n->l, out, k);
+	 collect_leaves(n->r, out, k);
+ }
+ 
+ /*
+  * ACTUALIZACIONES PUNTUALES:
+  * - Cambia un literal aleatorio y reevalúa: inc_set + inc_eval frente
+  *   a modificar el nodo y llamar a eval_tree desde la raíz
+  * - Comprueba que ambos caminos dan el mismo resultado
+  */
+ static int bench_incr_tree(const char *name, node *tree, long updates)
+ {
+	 long full_updates = 20;
+	 long long t_inc;
+	 long long t_full;
+	 long long t0;
+	 node **leaves;
+	 inc_tree t;
+	 long nleaf = 0;
+	 long i;
+	 int a = 0;
+	 int b = 0;
+	 
+	 if (inc_build(&t, tree) == -1)
+		 return 1;
+	 leaves = malloc(t.nleaf * sizeof(*leaves));
+	 if (!leaves)
+	 {
+		 inc_free(&t);
+		 return 1;
+	 }
+	 collect_leaves(tree, leaves, &nleaf);
+	 inc_eval(&t);
+	 
+	 t0 = now_ns();
+	 for (i = 0; i < updates; i++)
+	 {
+		 long k = bench_rand() % nleaf;
+		 int v = bench_rand() % 10;
+		 
+		 inc_set(&t, k, v);
+		 leaves[k]->val = v;
+		 a = inc_eval(&t);
+	 }
+	 t_inc = now_ns() - t0;
+	 
+	 t0 = now_ns();
+	 for (i = 0; i < full_updates; i++)
+	 {
+		 long k = bench_rand() % nleaf;
+		 int v = bench_rand() % 10;
+		 
+		 inc_set(&t, k, v);
+		 leaves[k]->val = v;
+		 b = eval_tree(tree);
+	 }
+	 t_full = now_ns() - t0;
+	 
+	 a = inc_eval(&t);
+	 printf("%-10s nodes=%d  incr: %8.1f ns/update  full: %10.1f ns/update  "
+		 "speedup: %.0fx %s\n", name, t.size, (double)t_inc / updates,
+		 (double)t_full / full_updates,
+		 ((double)t_full / full_updates) / ((double)t_inc / updates),
+		 a == b ? "ok" : "MISMATCH");
+	 free(leaves);
+	 inc_free(&t);
+	 return a != b;
+ }
+ 
+ static int bench_incr_main(void)
+ {
+	 node *tree;
+	 int err;
+	 
+	 tree = bench_balanced(1 << 19);
+	 err = bench_incr_tree("balanced", tree, 1000000);
+	 destroy_tree(tree);
+	 tree = bench_comb(1 << 15, 16);
+	 err |= bench_incr_tree("unbalanced", tree, 1000);
+	 destroy_tree(tree);
+	 return err;
+ }
+ 
+ /*
+  * CONTADORES HARDWARE:
+  * - perf_event_open para fallos de caché e instrucciones
+  * - Si el kernel no lo permite (contenedores, perf_event_paranoid),
+  *   se devuelve -1 y el benchmark informa solo de tiempos
+  */
+ static int perf_open(unsigned long long config)
+ {
+	 struct perf_event_attr attr;
+	 
+	 memset(&attr, 0, sizeof(attr));
+	 attr.size = sizeof(attr);
+	 attr.type = PERF_TYPE_HARDWARE;
+	 attr.config = config;
+	 attr.disabled = 1;
+	 attr.exclude_kernel = 1;
+	 attr.exclude_hv = 1;
+	 return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+ }
+ 
+ static void perf_start(int fd)
+ {
+	 if (fd == -1)
+		 return;
+	 ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	 ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+ }
+ 
+ static long long perf_stop(int fd)
+ {
+	 long long count;
+	 
+	 if (fd == -1)
+		 return -1;
+	 ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	 if (read(fd, &count, sizeof(count)) != sizeof(count))
+		 return -1;
+	 return count;
+ }
+ 
+ /*
+  * AST CON PUNTEROS vs ARRAYS PLANOS:
+  * - Mismo árbol balanceado de 1M nodos evaluado con eval_tree y eval_flat
+  */
+ static void bench_flat_one(const char *name, int (*run)(void *), void *arg,
+	 int reps, int fd_miss, int fd_ins)
+ {
+	 long long t0;
+	 long long t;
+	 long long miss;
+	 long long ins;
+	 volatile int sink;
+	 int i;
+	 
+	 sink = run(arg);  // Calentamiento
+	 perf_start(fd_miss);
+	 perf_start(fd_ins);
+	 t0 = now_ns();
+	 for (i = 0; i < reps; i++)
+		 sink = run(arg);
+	 t = now_ns() - t0;
+	 miss = perf_stop(fd_miss);
+	 ins = perf_stop(fd_ins);
+	 (void)sink;
+	 printf("%-10s %10.2f ms/eval", name, (double)t / reps / 1e6);
+	 if (miss >= 0)
+		 printf("  cache-misses: %lld/eval", miss / reps);
+	 if (ins >= 0)
+		 printf("  instructions: %lld/eval", ins / reps);
+	 printf("\n");
+ }
+ 
+ typedef struct flat_arg {
+	 flat f;
+	 int *scratch;
+ } flat_arg;
+ 
+ static int run_tree(void *arg)
+ {
+	 return eval_tree(arg);
+ }
+ 
+ static int run_flat(void *arg)
+ {
+	 flat_arg *a = arg;
+	 
+	 return eval_flat(&a->f, a->scratch);
+ }
+ 
+ static int bench_flat_main(void)
+ {
+	 flat_arg a;
+	 node *tree;
+	 int fd_miss;
+	 int fd_ins;
+	 
+	 tree = bench_balanced(1 << 19);
+	 if (flat_build(&a.f, tree) == -1)
+		 return 1;
+	 a.scratch = malloc(a.f.n * sizeof(int));
+	 if (!a.scratch)
+		 return 1;
+	 fd_miss = perf_open(PERF_COUNT_HW_CACHE_MISSES);
+	 fd_ins = perf_open(PERF_COUNT_HW_INSTRUCTIONS);
+	 if (fd_miss == -1)
+		 printf("(perf counters unavailable: timing only)\n");
+	 printf("nodes=%d node=%zu bytes, flat=%zu bytes/node\n", a.f.n,
+		 sizeof(node), 3 * sizeof(int) + 1);
+	 bench_flat_one("eval_tree", run_tree, tree, 20, fd_miss, fd_ins);
+	 bench_flat_one("eval_flat", run_flat, &a, 20, fd_miss, fd_ins);
+	 if (eval_tree(tree) != eval_flat(&a.f, a.scratch))
+		 printf("MISMATCH\n");
+	 if (fd_miss != -1)
+		 close(fd_miss);
+	 if (fd_ins != -1)
+		 close(fd_ins);
+	 free(a.scratch);
+	 flat_free(&a.f);
+	 destroy_tree(tree);
+	 return 0;
+ }
+ 
+ /*
+  * LOTES MÓDULO p:
+  * - Expresión balanceada de ~1000 nodos evaluada sobre 1M carriles
+  *   con literales aleatorios
+  * - Referencia: una eval_flat_ar escalar por carril; se comprueba
+  *   que ambos caminos coinciden
+  */
+ static int bench_batch_main(void)
+ {
+	 const int lanes = 1 << 20;
+	 const char *names[] = {"wrap", "sat", "mod"};
+	 int **in;
+	 int *out;
+	 int *scratch;
+	 long long t0;
+	 long long t_vec;
+	 long long t_ref;
+	 node *tree;
+	 flat f;
+	 arith a;
+	 int mode;
+	 int nleaf;
+	 int i;
+	 int k;
+	 int err = 0;
+	 
+	 tree = bench_balanced(512);
+	 if (flat_build(&f, tree) == -1)
+		 return 1;
+	 destroy_tree(tree);
+	 nleaf = (f.n + 1) / 2;
+	 in = malloc(nleaf * sizeof(*in));
+	 out = malloc(lanes * sizeof(*out));
+	 scratch = malloc(f.n * sizeof(*scratch));
+	 if (!in || !out || !scratch)
+		 return 1;
+	 for (k = 0; k < nleaf; k++)
+	 {
+		 in[k] = malloc(lanes * sizeof(**in));
+		 if (!in[k])
+			 return 1;
+		 for (i = 0; i < lanes; i++)
+			 in[k][i] = (int)bench_rand();
+	 }
+	 for (mode = AR_WRAP; mode <= AR_MOD; mode++)
+	 {
+		 arith_init(&a, mode, 1000000007u);
+		 t0 = now_ns();
+		 eval_flat_batch(&f, &a, (const int *const *)in, out, lanes);
+		 t_vec = now_ns() - t0;
+		 
+		 // Referencia escalar sobre una muestra de carriles
+		 t0 = now_ns();
+		 for (i = 0; i < lanes; i += 64)
+		 {
+			 int j = 0;
+			 
+			 for (k = 0; k < f.n; k++)
+				 if (f.op[k] == VAL)
+					 f.val[k] = in[j++][i];
+			 if (eval_flat_ar(&f, &a, scratch) != out[i])
+				 err = 1;
+		 }
+		 t_ref = (now_ns() - t0) * 64;
+		 printf("%-5s nodes=%d lanes=%d  batch: %6.2f ns/lane  scalar: "
+			 "%7.2f ns/lane  %s\n", names[mode], f.n, lanes,
+			 (double)t_vec / lanes, (double)t_ref / lanes,
+			 err ? "MISMATCH" : "ok");
+	 }
+	 for (k = 0; k < nleaf; k++)
+		 free(in[k]);
+	 free(in);
+	 free(out);
+	 free(scratch);
+	 flat_free(&f);
+	 return err;
+ }
+ 
+ /*
+  * GENERADOR DE EXPRESIONES ALEATORIAS:
+  * - leaves: número de literales objetivo
+  * - depth: profundidad máxima del árbol (al agotarse se emite un literal)
+  * - mul: probabilidad de '*' frente a '+'
+  * - paren: probabilidad de envolver un subárbol en paréntesis aunque
+  *   no haga falta
+  * - Los paréntesis necesarios se ponen siempre, para que el parser
+  *   reconstruya exactamente el árbol generado (y su profundidad):
+  *   need indica qué operadores necesitan paréntesis en esa posición
+  */
+ #define NEED_ADD 1
+ #define NEED_MULTI 2
+ 
+ typedef struct gen {
+	 char *buf;
+	 long len;
+	 double mul;
+	 double paren;
+	 int nvars;      // Variables disponibles ('a'...), 0 = solo dígitos
+	 double pvar;    // Probabilidad de que una hoja sea variable
+ } gen;
+ 
+ static double bench_unit(void)
+ {
+	 return bench_rand() / 4294967296.0;
+ }
+ 
+ static void gen_expr(gen *g, long leaves, int depth, int need)
+ {
+	 long split;
+	 int type;
+	 int wrap;
+	 
+	 if (leaves <= 1 || depth <= 1)
+	 {
+		 if (g->nvars && bench_unit() < g->pvar)
+			 g->buf[g->len++] = 'a' + bench_rand() % g->nvars;
+		 else
+			 g->buf[g->len++] = '0' + bench_rand() % 10;
+		 return;
+	 }
+	 type = bench_unit() < g->mul ? MULTI : ADD;
+	 wrap = (need & (type == ADD ? NEED_ADD : NEED_MULTI))
+		 || bench_unit() < g->paren;
+	 split = 1 + bench_rand() % (leaves - 1);
+	 if (wrap)
+		 g->buf[g->len++] = '(';
+	 if (type == ADD)
+	 {
+		 gen_expr(g, split, depth - 1, 0);
+		 g->buf[g->len++] = '+';
+		 gen_expr(g, leaves - split, depth - 1, NEED_ADD);
+	 }
+	 else
+	 {
+		 gen_expr(g, split, depth - 1, NEED_ADD);
+		 g->buf[g->len++] = '*';
+		 gen_expr(g, leaves - split, depth - 1, NEED_ADD | NEED_MULTI);
+	 }
+	 if (wrap)
+		 g->buf[g->len++] = ')';
+ }
+ 
+ // Cadena terminada en '\0' con malloc; cada literal aporta como mucho
+ // 4 caracteres (dígito, operador y un par de paréntesis)
+ static char *gen_string(long leaves, int depth, double mul, double paren,
+	 int nvars, double pvar)
+ {
+	 gen g;
+	 
+	 g.buf = malloc(4 * leaves + 2);
+	 if (!g.buf)
+		 return NULL;
+	 g.len = 0;
+	 g.mul = mul;
+	 g.paren = paren;
+	 g.nvars = nvars;
+	 g.pvar = pvar;
+	 gen_expr(&g, leaves, depth, 0);
+	 g.buf[g.len] = '\0';
+	 return g.buf;
+ }
+ 
+ /*
+  * PUERTA DE CORRECCIÓN:
+  * - Los ejemplos del enunciado se ejecutan antes de medir nada
+  * - Los casos de error solo deben devolver NULL; sus mensajes se
+  *   descartan redirigiendo stdout a /dev/null durante la puerta
+  */
+ static const struct {
+	 const char *expr;
+	 int ok;
+	 int val;
+ } subject_cases[] = {
+	 {"1", 1, 1},
+	 {"2+3", 1, 5},
+	 {"3*4+5", 1, 17},
+	 {"3+4*5", 1, 23},
+	 {"(3+4)*5", 1, 35},
+	 {"(((((2+2)*2+2)*2+2)*2+2)*2+2)*2", 1, 188},
+	 {"1+", 0, 0},
+	 {"1+2)", 0, 0},
+	 {"1+2+3+4+5", 1, 15},
+	 {"(1)", 1, 1},
+	 {"(((((((3)))))))", 1, 3},
+	 {"(1+2)*3", 1, 9},
+	 {"((6*6+7+5+8)*(1+0+4*8+7)+2)+4*(1+2)", 1, 2254},
+	 {"((1+3)*12+(3*(2+6))", 0, 0},
+	 {
+		 "2*4+9+3+2*1+5+1+6+6*1*1+8*0+0+5+0*4*9*5*8+9*7+5*1+3+1+4*5*7*3+0*3+4*"
+		 "8+8+8+4*0*5*3+5+4+5*7+9+6*6+7+9*2*6*9+2+1*3*7*1*1*5+1+2+7+4+3*4*2+0+"
+		 "4*4*2*2+6+7*5+9+0+8*4+6*7+5+4*4+2+5*5+1+6+3*5*9*9+7*4*3+7+4*9+3+0+1*"
+		 "8+1+2*9*4*5*1+0*1*9+5*3*5+9*6+5*4+5+5*8*6*4*9*2+0+0+1*5*3+6*8*0+0+2*"
+		 "3+7*5*6+8+6*6+9+3+7+0*0+5+2*8+2*7*2+3+9*1*4*8*7*9+2*0+1*6*4*2+8*8*3*"
+		 "1+8+2*4+8*3+8*3+9*5+2*3+9*5*6*4+3*6*6+7+4*8+0+2+9*8*0*6*8*1*2*7+0*5+"
+		 "6*5+0*2+7+2+3+8*7+6+1*3+5+4*5*4*6*1+4*7+9*0+4+9*8+7+5+6+2+6+1+1+1*6*"
+		 "0*9+7+6*2+4*4+1*6*2*9+3+0+0*1*8+4+6*2+6+2*7+7+0*9+6+2*1+6*5*2*3*5*2*"
+		 "6*4+2*9*2*4*5*2*2*3+8+8*3*2*3+0*5+9*6+8+3*1+6*9+8+9*2*0+2", 1, 94305},
+ };
+ 
+ static int bench_gate(void)
+ {
+	 int n = sizeof(subject_cases) / sizeof(subject_cases[0]);
+	 int failed = 0;
+	 int saved;
+	 int devnull;
+	 int i;
+	 
+	 fflush(stdout);
+	 saved = dup(STDOUT_FILENO);
+	 devnull = open("/dev/null", O_WRONLY);
+	 if (saved == -1 || devnull == -1)
+		 return -1;
+	 dup2(devnull, STDOUT_FILENO);
+	 for (i = 0; i < n; i++)
+	 {
+		 char *s = (char *)subject_cases[i].expr;
+		 node *tree = parse_expression(&s);
+		 
+		 if (!tree != !subject_cases[i].ok
+			 || (tree && eval_tree(tree) != subject_cases[i].val))
+			 failed++;
+		 destroy_tree(tree);
+	 }
+	 fflush(stdout);
+	 dup2(saved, STDOUT_FILENO);
+	 close(saved);
+	 close(devnull);
+	 printf("gate: %d/%d subject examples ok\n", n - failed, n);
+	 return failed ? -1 : 0;
+ }
+ 
+ /*
+  * MODO --bench:
+  * - Parámetros key=value: size (literales), depth, mul, paren,
+  *   seed, iters
+  * - Mide por separado parse, evaluación y destrucción, en ns/nodo
+  */
+ static int bench_main(int argc, char **argv)
+ {
+	 long leaves = 1 << 20;
+	 int depth = 64;
+	 double mul = 0.5;
+	 double paren = 0.1;
+	 int iters = 10;
+	 long long t0;
+	 long long t_parse = 0;
+	 long long t_eval = 0;
+	 long long t_destroy = 0;
+	 volatile int sink;
+	 long nodes = 0;
+	 char *expr;
+	 int i;
+	 
+	 for (i = 0; i < argc; i++)
+	 {
+		 if (!strncmp(argv[i], "size=", 5))
+			 leaves = strtol(argv[i] + 5, NULL, 10);
+		 else if (!strncmp(argv[i], "depth=", 6))
+			 depth = atoi(argv[i] + 6);
+		 else if (!strncmp(argv[i], "mul=", 4))
+			 mul = strtod(argv[i] + 4, NULL);
+		 else if (!strncmp(argv[i], "paren=", 6))
+			 paren = strtod(argv[i] + 6, NULL);
+		 else if (!strncmp(argv[i], "seed=", 5))
+			 bench_seed = strtoull(argv[i] + 5, NULL, 10) | 1;
+		 else if (!strncmp(argv[i], "iters=", 6))
+			 iters = atoi(argv[i] + 6);
+		 else
+		 {
+			 fprintf(stderr, "vbc: unknown bench option '%s'\n", argv[i]);
+			 return 1;
+		 }
+	 }
+	 if (bench_gate() == -1 || leaves < 1 || iters < 1)
+		 return 1;
+	 expr = gen_string(leaves, depth, mul, paren, 0, 0);
+	 if (!expr)
+		 return 1;
+	 
+	 for (i = 0; i < iters; i++)
+	 {
+		 char *s = expr;
+		 node *tree;
+		 
+		 t0 = now_ns();
+		 tree = parse_expression(&s);
+		 t_parse += now_ns() - t0;
+		 if (!tree)
+		 {
+			 free(expr);
+			 return 1;
+		 }
+		 nodes = count_nodes(tree);
+		 t0 = now_ns();
+		 sink = eval_tree(tree);
+		 t_eval += now_ns() - t0;
+		 t0 = now_ns();
+		 destroy_tree(tree);
+		 t_destroy += now_ns() - t0;
+	 }
+	 (void)sink;
+	 printf("size=%ld depth=%d mul=%.2f paren=%.2f chars=%zu nodes=%ld iters=%d\n",
+		 leaves, depth, mul, paren, strlen(expr), nodes, iters);
+	 printf("parse:   %8.2f ns/node\n", (double)t_parse / iters / nodes);
+	 printf("eval:    %8.2f ns/node\n", (double)t_eval / iters / nodes);
+	 printf("destroy: %8.2f ns/node\n", (double)t_destroy / iters / nodes);
+	 free(expr);
+	 return 0;
+ }
+
+ /*
+  * VALOR + GRADIENTE:
+  * - Expresión aleatoria con 3 variables (30% de las hojas)
+  * - Pasada fusionada (eval_grad) frente a eval_tree_env del original
+  *   más uno por cada árbol derivado y simplificado
+  */
+ static int bench_grad_main(void)
+ {
+	 int env[26];
+	 int slot[26];
+	 int grad[26];
+	 node *d[26];
+	 long long t0;
+	 long long t_fused;
+	 long long t_split;
+	 long dnodes = 0;
+	 node *tree;
+	 char *expr;
+	 char *s;
+	 int value;
+	 int sep[27];
+	 int reps = 20;
+	 int nv;
+	 int err = 0;
+	 int i;
+	 int k;
+	 
+	 expr = gen_string(1 << 18, 64, 0.5, 0.1, 3, 0.3);
+	 if (!expr)
+		 return 1;
+	 s = expr;
+	 tree = parse_expression_vars(&s);
+	 free(expr);
+	 if (!tree)
+		 return 1;
+	 for (i = 0; i < 26; i++)
+		 env[i] = bench_rand() % 10;
+	 nv = grad_vars(tree, slot);
+	 for (i = 0; i < 26; i++)
+		 if (slot[i] >= 0)
+		 {
+			 d[slot[i]] = derive(tree, i, &ar_wrap);
+			 dnodes += count_nodes(d[slot[i]]);
+		 }
+	 
+	 t0 = now_ns();
+	 for (k = 0; k < reps; k++)
+		 eval_grad(tree, &ar_wrap, env, slot, nv, &value, grad);
+	 t_fused = now_ns() - t0;
+	 t0 = now_ns();
+	 for (k = 0; k < reps; k++)
+	 {
+		 sep[0] = eval_tree_env(tree, env, &ar_wrap);
+		 for (i = 0; i < nv; i++)
+			 sep[i + 1] = eval_tree_env(d[i], env, &ar_wrap);
+	 }
+	 t_split = now_ns() - t0;
+	 
+	 err = sep[0] != value;
+	 for (i = 0; i < nv; i++)
+		 err |= sep[i + 1] != grad[i];
+	 printf("nodes=%ld vars=%d derivative nodes=%ld\n", count_nodes(tree), nv, dnodes);
+	 printf("fused value+gradient: %8.2f ms\n", (double)t_fused / reps / 1e6);
+	 printf("f + %d derivative trees: %8.2f ms  %s\n", nv,
+		 (double)t_split / reps / 1e6, err ? "MISMATCH" : "ok");
+	 for (i = 0; i < nv; i++)
+		 destroy_tree(d[i]);
+	 destroy_tree(tree);
+	 return err;
+ }
+ 
+ /*
+  * CORTOCIRCUITO CON DATOS DISPERSOS:
+  * - Expresión aleatoria con 8 variables (40% de las hojas, 70% de '*')
+  * - 200 entornos en los que cada variable vale 0 con probabilidad 0.8
+  * - eval_tree_env frente a eval_tree_sc; con -DVBC_PROFILE, también
+  *   los nodos que visita eval_tree_sc de media (sus propios contadores)
+  */
+ static int bench_sc_main(void)
+ {
+	 const int nenv = 200;
+	 int (*env)[26];
+	 long long t0;
+	 long long t_full;
+	 long long t_sc;
+	 volatile int sink;
+	 arith mod;
+	 node *tree;
+	 int *size;
+	 char *expr;
+	 char *s;
+	 int err = 0;
+	 int i;
+	 int k;
+	 
+	 expr = gen_string(1 << 18, 64, 0.7, 0.1, 8, 0.4);
+	 if (!expr)
+		 return 1;
+	 s = expr;
+	 tree = parse_expression_vars(&s);
+	 free(expr);
+	 env = malloc(nenv * sizeof(*env));
+	 size = tree ? malloc(count_nodes(tree) * sizeof(*size)) : NULL;
+	 if (!tree || !env || !size)
+		 return 1;
+	 sc_sizes(tree, size);
+	 for (k = 0; k < nenv; k++)
+		 for (i = 0; i < 26; i++)
+			 env[k][i] = bench_unit() < 0.8 ? 0 : 1 + bench_rand() % 9;
+	 
+	 t0 = now_ns();
+	 for (k = 0; k < nenv; k++)
+		 sink = eval_tree_env(tree, env[k], &ar_wrap);
+	 t_full = now_ns() - t0;
+	 t0 = now_ns();
+	 for (k = 0; k < nenv; k++)
+		 sink = eval_tree_sc(tree, env[k], size, &ar_wrap);
+	 t_sc = now_ns() - t0;
+	 (void)sink;
+	 arith_init(&mod, AR_MOD, 1000000007u);
+	 for (k = 0; k < nenv; k++)
+		 if (eval_tree_env(tree, env[k], &mod) != eval_tree_sc(tree, env[k], size, &mod))
+			 err = 1;
+	 PROF(memset(g_prof.evals, 0, sizeof(g_prof.evals)));
+	 for (k = 0; k < nenv; k++)
+		 if (eval_tree_env(tree, env[k], &ar_wrap)
+			 != eval_tree_sc(tree, env[k], size, &ar_wrap))
+			 err = 1;
+	 printf("nodes=%ld envs=%d p(zero)=0.8\n", count_nodes(tree), nenv);
+	 printf("eval_tree_env: %8.1f us/eval\n", (double)t_full / nenv / 1e3);
+	 printf("eval_tree_sc:  %8.1f us/eval  %s\n", (double)t_sc / nenv / 1e3,
+		 err ? "MISMATCH" : "ok");
+	 PROF(printf("eval_tree_sc visits %.1f%% of the nodes\n", 100.0 * (g_prof.evals[ADD]
+		 + g_prof.evals[MULTI] + g_prof.evals[VAL] + g_prof.evals[VAR]) / nenv
+		 / count_nodes(tree)));
+	 free(size);
+	 free(env);
+	 destroy_tree(tree);
+	 return err;
+ }
+ 
+ /*
+  * CONTEXTOS (vbc_ctx) FRENTE AL PARSER CLÁSICO:
+  * - Misma fórmula (unos 1000 nodos) compilada y evaluada 20000 veces:
+  *   parse_expression + destroy_tree (un malloc/free por nodo) contra
+  *   vbc_parse + vbc_reset (arena reutilizada, sin malloc tras la
+  *   primera vuelta)
+  * - 4 hilos, cada uno con su contexto, repiten los casos del
+  *   enunciado y comparan resultado y mensaje de error con la
+  *   referencia de un solo hilo: ni estado compartido ni salida mezclada
+  */
+ typedef struct ctx_job {
+	 int rounds;
+	 int bad;
+ } ctx_job;
+ 
+ static void *bench_ctx_thread(void *arg)
+ {
+	 ctx_job *job = arg;
+	 int n = sizeof(subject_cases) / sizeof(subject_cases[0]);
+	 vbc_ctx ctx;
+	 node *tree;
+	 int i;
+	 int k;
+	 
+	 vbc_ctx_init(&ctx, 0, NULL);
+	 for (k = 0; k < job->rounds; k++)
+		 for (i = 0; i < n; i++)
+		 {
+			 tree = vbc_parse(&ctx, subject_cases[i].expr);
+			 if (!tree != !subject_cases[i].ok
+				 || (tree && vbc_eval(&ctx, tree, NULL) != subject_cases[i].val)
+				 || (!tree && strncmp(vbc_error(&ctx), "Unexpected ", 11)))
+				 job->bad++;
+			 vbc_reset(&ctx);
+		 }
+	 vbc_ctx_free(&ctx);
+	 return NULL;
+ }
+ 
+ static int bench_ctx_main(void)
+ {
+	 const int reps = 20000;
+	 pthread_t th[4];
+	 ctx_job jobs[4];
+	 long long t0;
+	 long long t_heap;
+	 long long t_ctx;
+	 vbc_ctx ctx;
+	 node *tree;
+	 char *expr;
+	 char *s;
+	 int ref;
+	 int err = 0;
+	 int i;
+	 
+	 expr = gen_string(500, 16, 0.5, 0.2, 0, 0);
+	 if (!expr)
+		 return 1;
+	 s = expr;
+	 tree = parse_expression(&s);
+	 if (!tree)
+		 return 1;
+	 ref = eval_tree(tree);
+	 printf("nodes=%ld reps=%d\n", count_nodes(tree), reps);
+	 destroy_tree(tree);
+	 
+	 t0 = now_ns();
+	 for (i = 0; i < reps; i++)
+	 {
+		 s = expr;
+		 tree = parse_expression(&s);
+		 if (!tree || eval_tree(tree) != ref)
+			 err = 1;
+		 destroy_tree(tree);
+	 }
+	 t_heap = now_ns() - t0;
+	 vbc_ctx_init(&ctx, 0, NULL);
+	 t0 = now_ns();
+	 for (i = 0; i < reps; i++)
+	 {
+		 tree = vbc_parse(&ctx, expr);
+		 if (!tree || vbc_eval(&ctx, tree, NULL) != ref)
+			 err = 1;
+		 vbc_reset(&ctx);
+	 }
+	 t_ctx = now_ns() - t0;
+	 if (vbc_parse(&ctx, "(1+2") || strcmp(vbc_error(&ctx), "Unexpected end of input")
+		 || ctx.err_pos != 4)
+		 err = 1;
+	 vbc_ctx_free(&ctx);
+	 free(expr);
+	 printf("heap  (parse_expression): %8.1f us/call\n", (double)t_heap / reps / 1e3);
+	 printf("arena (vbc_parse):        %8.1f us/call\n", (double)t_ctx / reps / 1e3);
+	 
+	 for (i = 0; i < 4; i++)
+	 {
+		 jobs[i].rounds = 50000;
+		 jobs[i].bad = 0;
+		 if (pthread_create(&th[i], NULL, bench_ctx_thread, &jobs[i]))
+			 return 1;
+	 }
+	 for (i = 0; i < 4; i++)
+	 {
+		 pthread_join(th[i], NULL);
+		 err |= jobs[i].bad != 0;
+	 }
+	 printf("4 threads x %d rounds of the subject cases: %s\n",
+		 jobs[0].rounds, err ? "MISMATCH" : "ok");
+	 return err;
+ }
+ #endif
+ 
+ /*
+  * FUNCIÓN MAIN:
+  */
+ /*
+  * OPCIONES DE ARITMÉTICA:
+  * - --wrap, --sat o --mod <p> delante del resto de argumentos
+  * - Devuelve cuántos argumentos consumió, o -1 si son inválidos
+  */
+ static int parse_arith_opts(int argc, char **argv, arith *a)
+ {
+	 int i = 1;
+	 
+	 *a = ar_wrap;
+	 while (i < argc)
+	 {
+		 if (!strcmp(argv[i], "--wrap"))
+			 arith_init(a, AR_WRAP, 0);
+		 else if (!strcmp(argv[i], "--sat"))
+			 arith_init(a, AR_SAT, 0);
+		 else if (!strcmp(argv[i], "--mod") && i + 1 < argc)
+		 {
+			 if (arith_init(a, AR_MOD, strtoul(argv[++i], NULL, 10)) == -1)
+				 return -1;
+		 }
+		 else
+			 break;
+		 i++;
+	 }
+	 return i - 1;
+ }
+ 
+ int main(int argc, char **argv)
+ {
+	 arith ar;
+	 int nopt;
+	 int result;
+	 
+ #ifdef VBC_PROFILE
+	 atexit(prof_report);
+ #endif
+	 /*
+	  * MODOS EXTENDIDOS:
+	  * - Solo se activan con una opción explícita en argv[1]
+	  * - Sin opción, el comportamiento es exactamente el del ejercicio
+	  */
+	 nopt = parse_arith_opts(argc, argv, &ar);
+	 if (nopt == -1)
+		 return 1;
+	 argc -= nopt;
+	 argv += nopt;
+	 if (argc == 3 && !strcmp(argv[1], "--emit-c"))
+		 return emit_c_main(argv[2], &ar);
+	 if (argc == 4 && !strcmp(argv[1], "--emit-so"))
+		 return emit_so_main(argv[2], argv[3], &ar);
+	 if (argc == 3 && !strcmp(argv[1], "--incr"))
+		 return incr_main(argv[2], &ar);
+	 if (argc == 3 && !strcmp(argv[1], "--flat"))
+		 return flat_main(argv[2], &ar);
+	 if ((argc == 3 || argc == 4) && !strcmp(argv[1], "--db-build"))
+		 return db_build_main(argv[2], argv[3]);
+	 if (argc >= 4 && !strcmp(argv[1], "--db"))
+		 return db_main(argv[2], argc - 3, argv + 3, &ar);
+	 if (argc >= 3 && !strcmp(argv[1], "--grad"))
+		 return grad_main(argv[2], argc - 3, argv + 3, &ar);
+	 if (argc >= 3 && !strcmp(argv[1], "--analyze"))
+		 return analyze_main(argv[2], argc - 3, argv + 3, &ar);
+	 if ((argc == 2 || argc == 3) && !strcmp(argv[1], "--stream"))
+		 return stream_main(argv[2], &ar);
+	 if ((argc == 2 || argc == 3) && !strcmp(argv[1], "--lint"))
+		 return lint_main(argv[2]);
+ #ifdef VBC_BENCH
+	 if (argc >= 2 && !strcmp(argv[1], "--bench"))
+		 return bench_main(argc - 2, argv + 2);
+	 if (argc == 2 && !strcmp(argv[1], "--bench-incr"))
+		 return bench_incr_main();
+	 if (argc == 2 && !strcmp(argv[1], "--bench-flat"))
+		 return bench_flat_main();
+	 if (argc == 2 && !strcmp(argv[1], "--bench-sc"))
+		 return bench_sc_main();
+	 if (argc == 2 && !strcmp(argv[1], "--bench-ctx"))
+		 return bench_ctx_main();
+	 if (argc == 2 && !strcmp(argv[1], "--bench-grad"))
+		 return bench_grad_main();
+	 if (argc == 2 && !strcmp(argv[1], "--bench-batch"))
+		 return bench_batch_main();
+ #endif
+	 
+	 if (argc != 2)
+		 return 1;
+	 
+	 char *input = argv[1];
+	 PROF_BEGIN(PH_PARSE);
+	 node *tree = parse_expression(&input);
+	 PROF_END(PH_PARSE);
+	 
+	 if (!tree)
+		 return 1;
+	 
+	 PROF_BEGIN(PH_EVAL);
+	 if (nopt)
+		 result = eval_tree_ar(tree, &ar);
+	 else
+		 result = eval_tree(tree);
+	 PROF_END(PH_EVAL);
+	 printf("%d\n", result);
+	 PROF_BEGIN(PH_DESTROY);
 	 destroy_tree(tree);
+	 PROF_END(PH_DESTROY);
 	 return 0;
  }
  
@@ -426,6 +3715,7 @@
   * 4. SIN OPTIMIZACIÓN:
   *    - El AST se evalúa directamente
   *    - Un compilador real generaría código máquina
+  *    - --emit-c / --emit-so generan C y lo compilan con el cc local
   */
  
  /*